@@ -1,4 +1,5 @@
-#include "tokenization.cpp"
+#include "symbol_table.cpp"
+#include "ast_arena.cpp"
 
 
 /*2. Abstract Syntax Tree (AST)
@@ -9,10 +10,20 @@ The AST represents the hierarchical structure of the source code. Each node corr
 
 class ExprVisitor; // Forward declaration
 
+// Which subclass a node is, for code that walks the tree with a switch instead of accept().
+enum class ExprKind : uint8_t { LITERAL, VARIABLE, UNARY, BINARY, ASSIGNMENT };
+
 class Expr {
 public:
+    const ExprKind kind;
+
+    explicit Expr(ExprKind kind) : kind(kind) {}
     virtual ~Expr() = default;
     virtual void accept(ExprVisitor& visitor) = 0;
+
+    // Nodes go to the current AstArena when one is active (see Parser::parse(AstArena&)).
+    static void* operator new(size_t size) { return AstNodeAllocator::allocate(size); }
+    static void operator delete(void* node) { AstNodeAllocator::release(node); }
 };
 
 class LiteralExpr;
@@ -36,7 +47,7 @@ class LiteralExpr : public Expr {
 public:
     double value;
 
-    LiteralExpr(double value) : value(value) {}
+    LiteralExpr(double value) : Expr(ExprKind::LITERAL), value(value) {}
 
     void accept(ExprVisitor& visitor) override {
         visitor.visitLiteralExpr(*this);
@@ -46,9 +57,11 @@ public:
 // Variable Expression
 class VariableExpr : public Expr {
 public:
-    Token name;
+    SymbolToken name;
+    int depth = -1; // Filled in by the Resolver: scopes between use and declaration
+    int slot = -1;  // Filled in by the Resolver: index in the declaring scope
 
-    VariableExpr(const Token& name) : name(name) {}
+    VariableExpr(const SymbolToken& name) : Expr(ExprKind::VARIABLE), name(name) {}
 
     void accept(ExprVisitor& visitor) override {
         visitor.visitVariableExpr(*this);
@@ -58,11 +71,11 @@ public:
 // Unary Expression
 class UnaryExpr : public Expr {
 public:
-    Token op;
+    SymbolToken op;
     std::unique_ptr<Expr> right;
 
-    UnaryExpr(const Token& op, std::unique_ptr<Expr> right)
-        : op(op), right(std::move(right)) {}
+    UnaryExpr(const SymbolToken& op, std::unique_ptr<Expr> right)
+        : Expr(ExprKind::UNARY), op(op), right(std::move(right)) {}
 
     void accept(ExprVisitor& visitor) override {
         visitor.visitUnaryExpr(*this);
@@ -73,11 +86,11 @@ public:
 class BinaryExpr : public Expr {
 public:
     std::unique_ptr<Expr> left;
-    Token op;
+    SymbolToken op;
     std::unique_ptr<Expr> right;
 
-    BinaryExpr(std::unique_ptr<Expr> left, const Token& op, std::unique_ptr<Expr> right)
-        : left(std::move(left)), op(op), right(std::move(right)) {}
+    BinaryExpr(std::unique_ptr<Expr> left, const SymbolToken& op, std::unique_ptr<Expr> right)
+        : Expr(ExprKind::BINARY), left(std::move(left)), op(op), right(std::move(right)) {}
 
     void accept(ExprVisitor& visitor) override {
         visitor.visitBinaryExpr(*this);
@@ -87,11 +100,13 @@ public:
 // Assignment Expression
 class AssignmentExpr : public Expr {
 public:
-    Token name;
+    SymbolToken name;
     std::unique_ptr<Expr> value;
+    int depth = -1; // Filled in by the Resolver
+    int slot = -1;
 
-    AssignmentExpr(const Token& name, std::unique_ptr<Expr> value)
-        : name(name), value(std::move(value)) {}
+    AssignmentExpr(const SymbolToken& name, std::unique_ptr<Expr> value)
+        : Expr(ExprKind::ASSIGNMENT), name(name), value(std::move(value)) {}
 
     void accept(ExprVisitor& visitor) override {
         visitor.visitAssignmentExpr(*this);
@@ -102,10 +117,19 @@ public:
 
 class StmtVisitor; // Forward declaration
 
+enum class StmtKind : uint8_t { EXPRESSION, VARIABLE_DECLARATION, BLOCK, IF, WHILE, PRINT };
+
 class Stmt {
 public:
+    int line = 0; // Line of the statement's first token, set by the Parser
+    const StmtKind kind;
+
+    explicit Stmt(StmtKind kind) : kind(kind) {}
     virtual ~Stmt() = default;
     virtual void accept(StmtVisitor& visitor) = 0;
+
+    static void* operator new(size_t size) { return AstNodeAllocator::allocate(size); }
+    static void operator delete(void* node) { AstNodeAllocator::release(node); }
 };
 
 class ExpressionStmt;
@@ -132,7 +156,7 @@ public:
     std::unique_ptr<Expr> expression;
 
     ExpressionStmt(std::unique_ptr<Expr> expression)
-        : expression(std::move(expression)) {}
+        : Stmt(StmtKind::EXPRESSION), expression(std::move(expression)) {}
 
     void accept(StmtVisitor& visitor) override {
         visitor.visitExpressionStmt(*this);
@@ -142,11 +166,13 @@ public:
 // Variable Declaration Statement
 class VariableDeclarationStmt : public Stmt {
 public:
-    Token name;
+    SymbolToken name;
     std::unique_ptr<Expr> initializer;
+    int depth = -1; // Filled in by the Resolver, always 0 once resolved
+    int slot = -1;
 
-    VariableDeclarationStmt(const Token& name, std::unique_ptr<Expr> initializer)
-        : name(name), initializer(std::move(initializer)) {}
+    VariableDeclarationStmt(const SymbolToken& name, std::unique_ptr<Expr> initializer)
+        : Stmt(StmtKind::VARIABLE_DECLARATION), name(name), initializer(std::move(initializer)) {}
 
     void accept(StmtVisitor& visitor) override {
         visitor.visitVariableDeclarationStmt(*this);
@@ -157,9 +183,10 @@ public:
 class BlockStmt : public Stmt {
 public:
     std::vector<std::unique_ptr<Stmt>> statements;
+    int slotCount = -1; // Filled in by the Resolver: variables declared directly in this block
 
     BlockStmt(std::vector<std::unique_ptr<Stmt>> statements)
-        : statements(std::move(statements)) {}
+        : Stmt(StmtKind::BLOCK), statements(std::move(statements)) {}
 
     void accept(StmtVisitor& visitor) override {
         visitor.visitBlockStmt(*this);
@@ -174,7 +201,8 @@ public:
     std::unique_ptr<Stmt> elseBranch;
 
     IfStmt(std::unique_ptr<Expr> condition, std::unique_ptr<Stmt> thenBranch, std::unique_ptr<Stmt> elseBranch)
-        : condition(std::move(condition)), thenBranch(std::move(thenBranch)), elseBranch(std::move(elseBranch)) {}
+        : Stmt(StmtKind::IF), condition(std::move(condition)), thenBranch(std::move(thenBranch)),
+          elseBranch(std::move(elseBranch)) {}
 
     void accept(StmtVisitor& visitor) override {
         visitor.visitIfStmt(*this);
@@ -186,9 +214,10 @@ class WhileStmt : public Stmt {
 public:
     std::unique_ptr<Expr> condition;
     std::unique_ptr<Stmt> body;
+    long long tripCount = -1; // Filled in by the LoopAnalyzer when the iteration count is known
 
     WhileStmt(std::unique_ptr<Expr> condition, std::unique_ptr<Stmt> body)
-        : condition(std::move(condition)), body(std::move(body)) {}
+        : Stmt(StmtKind::WHILE), condition(std::move(condition)), body(std::move(body)) {}
 
     void accept(StmtVisitor& visitor) override {
         visitor.visitWhileStmt(*this);
@@ -201,10 +230,89 @@ public:
     std::unique_ptr<Expr> expression;
 
     PrintStmt(std::unique_ptr<Expr> expression)
-        : expression(std::move(expression)) {}
+        : Stmt(StmtKind::PRINT), expression(std::move(expression)) {}
 
     void accept(StmtVisitor& visitor) override {
         visitor.visitPrintStmt(*this);
     }
 };
+
+// Destroying a node destroys its children first, one nested call per level, which a deep
+// enough tree turns into a stack overflow. TreeReleaser moves every node's children out to a
+// work list before destroying the node, so trees of any depth are released in constant stack.
+class TreeReleaser {
+public:
+    void add(std::unique_ptr<Expr> expr) {
+        if (expr) expressions.push_back(std::move(expr));
+    }
+
+    void add(std::unique_ptr<Stmt> stmt) {
+        if (stmt) statements.push_back(std::move(stmt));
+    }
+
+    void add(std::vector<std::unique_ptr<Stmt>>& list) {
+        for (auto& stmt : list) add(std::move(stmt));
+        list.clear();
+    }
+
+    void run() {
+        while (!statements.empty() || !expressions.empty()) {
+            if (!statements.empty()) {
+                std::unique_ptr<Stmt> stmt = std::move(statements.back());
+                statements.pop_back();
+                detach(*stmt);
+            } else {
+                std::unique_ptr<Expr> expr = std::move(expressions.back());
+                expressions.pop_back();
+                detach(*expr);
+            }
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<Expr>> expressions;
+    std::vector<std::unique_ptr<Stmt>> statements;
+
+    void detach(Expr& expr) {
+        switch (expr.kind) {
+            case ExprKind::LITERAL:
+            case ExprKind::VARIABLE:
+                break;
+            case ExprKind::UNARY: add(std::move(static_cast<UnaryExpr&>(expr).right)); break;
+            case ExprKind::BINARY:
+                add(std::move(static_cast<BinaryExpr&>(expr).left));
+                add(std::move(static_cast<BinaryExpr&>(expr).right));
+                break;
+            case ExprKind::ASSIGNMENT: add(std::move(static_cast<AssignmentExpr&>(expr).value)); break;
+        }
+    }
+
+    void detach(Stmt& stmt) {
+        switch (stmt.kind) {
+            case StmtKind::EXPRESSION: add(std::move(static_cast<ExpressionStmt&>(stmt).expression)); break;
+            case StmtKind::VARIABLE_DECLARATION:
+                add(std::move(static_cast<VariableDeclarationStmt&>(stmt).initializer));
+                break;
+            case StmtKind::BLOCK: add(static_cast<BlockStmt&>(stmt).statements); break;
+            case StmtKind::IF: {
+                IfStmt& ifStmt = static_cast<IfStmt&>(stmt);
+                add(std::move(ifStmt.condition));
+                add(std::move(ifStmt.thenBranch));
+                add(std::move(ifStmt.elseBranch));
+                break;
+            }
+            case StmtKind::WHILE:
+                add(std::move(static_cast<WhileStmt&>(stmt).condition));
+                add(std::move(static_cast<WhileStmt&>(stmt).body));
+                break;
+            case StmtKind::PRINT: add(std::move(static_cast<PrintStmt&>(stmt).expression)); break;
+        }
+    }
+};
+
+inline void releaseTree(std::vector<std::unique_ptr<Stmt>>& statements) {
+    TreeReleaser releaser;
+    releaser.add(statements);
+    releaser.run();
+}
 #endif
\ No newline at end of file
@@ -0,0 +1,123 @@
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+/*2a. AST Arena
+A bump allocator that owns every node built while it is active. Nodes from one parse sit
+next to each other in a few large blocks, and the blocks are released together when the
+arena is destroyed instead of one free() per node.*/
+
+#ifndef AST_ARENA
+#define AST_ARENA
+
+class AstArena {
+public:
+    static constexpr size_t kAlignment = alignof(std::max_align_t);
+
+    explicit AstArena(size_t blockSize = 64 * 1024) : blockSize(blockSize) {}
+
+    AstArena(const AstArena&) = delete;
+    AstArena& operator=(const AstArena&) = delete;
+
+    ~AstArena() {
+        for (char* block : blocks) {
+            ::operator delete(block);
+        }
+    }
+
+    void* allocate(size_t size) {
+        size = (size + kAlignment - 1) & ~(kAlignment - 1);
+        if (size > static_cast<size_t>(limit - next)) {
+            grow(size);
+        }
+        void* memory = next;
+        next += size;
+        bytesUsed += size;
+        nodes++;
+        return memory;
+    }
+
+    // Takes over every block of other, so nodes built there now live as long as this arena.
+    // Those nodes still name other in their header, which only matters for telling them from heap nodes.
+    void adopt(AstArena& other) {
+        blocks.insert(blocks.end(), other.blocks.begin(), other.blocks.end());
+        bytesUsed += other.bytesUsed;
+        reserved += other.reserved;
+        nodes += other.nodes;
+        other.blocks.clear();
+        other.next = other.limit = nullptr;
+        other.bytesUsed = other.reserved = other.nodes = 0;
+    }
+
+    size_t nodeCount() const { return nodes; }
+    size_t bytesAllocated() const { return bytesUsed; }
+    size_t bytesReserved() const { return reserved; }
+
+    // The arena new nodes go to on this thread, or nullptr for the ordinary heap.
+    static AstArena*& current() {
+        thread_local AstArena* arena = nullptr;
+        return arena;
+    }
+
+private:
+    size_t blockSize;
+    std::vector<char*> blocks;
+    char* next = nullptr;
+    char* limit = nullptr;
+    size_t bytesUsed = 0;
+    size_t reserved = 0;
+    size_t nodes = 0;
+
+    void grow(size_t size) {
+        size_t capacity = size > blockSize ? size : blockSize;
+        char* block = static_cast<char*>(::operator new(capacity));
+        blocks.push_back(block);
+        next = block;
+        limit = block + capacity;
+        reserved += capacity;
+    }
+};
+
+// Makes an arena current for the lifetime of the scope.
+class ArenaScope {
+public:
+    explicit ArenaScope(AstArena& arena) : previous(AstArena::current()) {
+        AstArena::current() = &arena;
+    }
+
+    ~ArenaScope() {
+        AstArena::current() = previous;
+    }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+private:
+    AstArena* previous;
+};
+
+// Every node carries a header naming the arena that owns it (nullptr for heap nodes), so nodes
+// built outside a parse, e.g. by later passes, can still be freed normally. The header holds one
+// pointer but takes kAlignment bytes (16 on common 64-bit targets), so the node after it stays
+// aligned for any type; bytesAllocated() includes it.
+struct AstNodeAllocator {
+    static constexpr size_t kHeader = AstArena::kAlignment;
+
+    static void* allocate(size_t size) {
+        AstArena* arena = AstArena::current();
+        void* block = arena ? arena->allocate(size + kHeader) : ::operator new(size + kHeader);
+        *static_cast<AstArena**>(block) = arena;
+        return static_cast<char*>(block) + kHeader;
+    }
+
+    static void release(void* node) {
+        if (node == nullptr) return;
+        void* block = static_cast<char*>(node) - kHeader;
+        if (*static_cast<AstArena**>(block) == nullptr) {
+            ::operator delete(block);
+        }
+        // Arena nodes are reclaimed all at once when their arena is destroyed.
+    }
+};
+#endif
@@ -0,0 +1,367 @@
+#include "enviroment_interpretation.cpp"
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+// 10. Batch Execution (WorkStealingPool, BatchRunner)
+// Runs many scripts concurrently. Every distinct script is parsed, optimized and resolved once,
+// and the resulting tree is shared read-only by every job that runs it. Each job gets its own
+// Interpreter (environments, value stack, output buffer), so jobs share no mutable state, and
+// its output and errors are captured and returned in submission order. A fingerprint of every
+// shared tree, taken before and after the batch, verifies that execution never mutated it.
+
+#ifndef BATCH_RUNNER
+#define BATCH_RUNNER
+
+// Hashes everything execution could observe in a tree: structure, values, names, lines and
+// the Resolver/LoopAnalyzer annotations. Two equal fingerprints mean an unchanged tree.
+class AstFingerprint : public ExprVisitor, public StmtVisitor {
+public:
+    uint64_t compute(const std::vector<std::unique_ptr<Stmt>>& statements) {
+        hash = kOffsetBasis;
+        for (const auto& stmt : statements) {
+            stmt->accept(*this);
+        }
+        return hash;
+    }
+
+private:
+    static constexpr uint64_t kOffsetBasis = 14695981039346656037ull;
+    static constexpr uint64_t kPrime = 1099511628211ull;
+
+    uint64_t hash = kOffsetBasis;
+
+    void mixBytes(const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * kPrime;
+        }
+    }
+
+    template <typename T>
+    void mix(const T& value) {
+        mixBytes(&value, sizeof(value));
+    }
+
+    void mix(const SymbolToken& token) {
+        mix(static_cast<int>(token.type));
+        mixBytes(token.lexeme.data(), token.lexeme.size());
+        mix(token.line);
+    }
+
+    // ExprVisitor implementations
+    void visitLiteralExpr(LiteralExpr& expr) override {
+        mix('L');
+        mix(expr.value);
+    }
+
+    void visitVariableExpr(VariableExpr& expr) override {
+        mix('V');
+        mix(expr.name);
+        mix(expr.depth);
+        mix(expr.slot);
+    }
+
+    void visitUnaryExpr(UnaryExpr& expr) override {
+        mix('U');
+        mix(expr.op);
+        expr.right->accept(*this);
+    }
+
+    void visitBinaryExpr(BinaryExpr& expr) override {
+        mix('B');
+        mix(expr.op);
+        expr.left->accept(*this);
+        expr.right->accept(*this);
+    }
+
+    void visitAssignmentExpr(AssignmentExpr& expr) override {
+        mix('A');
+        mix(expr.name);
+        mix(expr.depth);
+        mix(expr.slot);
+        expr.value->accept(*this);
+    }
+
+    // StmtVisitor implementations
+    void visitExpressionStmt(ExpressionStmt& stmt) override {
+        mix('e');
+        mix(stmt.line);
+        stmt.expression->accept(*this);
+    }
+
+    void visitVariableDeclarationStmt(VariableDeclarationStmt& stmt) override {
+        mix('l');
+        mix(stmt.line);
+        mix(stmt.name);
+        mix(stmt.slot);
+        if (stmt.initializer) stmt.initializer->accept(*this);
+    }
+
+    void visitBlockStmt(BlockStmt& stmt) override {
+        mix('b');
+        mix(stmt.line);
+        mix(stmt.slotCount);
+        mix(stmt.statements.size());
+        for (const auto& statement : stmt.statements) statement->accept(*this);
+    }
+
+    void visitIfStmt(IfStmt& stmt) override {
+        mix('i');
+        mix(stmt.line);
+        stmt.condition->accept(*this);
+        stmt.thenBranch->accept(*this);
+        mix(stmt.elseBranch != nullptr);
+        if (stmt.elseBranch) stmt.elseBranch->accept(*this);
+    }
+
+    void visitWhileStmt(WhileStmt& stmt) override {
+        mix('w');
+        mix(stmt.line);
+        mix(stmt.tripCount);
+        stmt.condition->accept(*this);
+        stmt.body->accept(*this);
+    }
+
+    void visitPrintStmt(PrintStmt& stmt) override {
+        mix('p');
+        mix(stmt.line);
+        stmt.expression->accept(*this);
+    }
+};
+
+// Runs a fixed set of tasks on worker threads. Each worker owns a deque of task indices: it
+// takes work from the back of its own and, once that is empty, steals from the front of the
+// others'. No task is added while the pool runs, so a worker that finds every deque empty is done.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(size_t threads) : threadCount(threads > 0 ? threads : 1) {}
+
+    // Calls task(i) for every i in [0, count) and returns once all calls have finished.
+    // The first exception thrown by a task is rethrown here.
+    void run(size_t count, const std::function<void(size_t)>& task) {
+        if (count == 0) return;
+        size_t workers = std::min(threadCount, count);
+        std::vector<WorkQueue> queues(workers);
+        // Contiguous ranges keep neighbouring jobs, often the same script, on one worker.
+        for (size_t i = 0; i < count; ++i) {
+            queues[i * workers / count].items.push_back(i);
+        }
+
+        std::exception_ptr failure;
+        std::mutex failureLock;
+        auto work = [&](size_t self) {
+            try {
+                size_t index;
+                while (take(queues, self, index)) {
+                    task(index);
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> guard(failureLock);
+                if (!failure) failure = std::current_exception();
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (size_t w = 1; w < workers; ++w) {
+            threads.emplace_back(work, w);
+        }
+        work(0);
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        if (failure) std::rethrow_exception(failure);
+    }
+
+    size_t threads() const { return threadCount; }
+    size_t steals() const { return stolen.load(); }
+
+private:
+    struct WorkQueue {
+        std::mutex lock;
+        std::deque<size_t> items;
+    };
+
+    size_t threadCount;
+    std::atomic<size_t> stolen{0};
+
+    bool take(std::vector<WorkQueue>& queues, size_t self, size_t& index) {
+        {
+            WorkQueue& own = queues[self];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (!own.items.empty()) {
+                index = own.items.back();
+                own.items.pop_back();
+                return true;
+            }
+        }
+        for (size_t offset = 1; offset < queues.size(); ++offset) {
+            WorkQueue& victim = queues[(self + offset) % queues.size()];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.items.empty()) {
+                index = victim.items.front();
+                victim.items.pop_front();
+                stolen++;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+struct BatchJob {
+    std::string name;
+    std::string source;
+};
+
+struct BatchResult {
+    std::string name;
+    std::string output;  // everything the job printed
+    std::string errors;  // resolve and runtime errors
+};
+
+struct BatchStats {
+    size_t jobs = 0;
+    size_t scripts = 0;       // distinct sources, each parsed once
+    size_t threads = 0;
+    size_t steals = 0;
+    double prepareSeconds = 0;
+    double runSeconds = 0;
+    bool astUnchanged = true; // every shared tree had the same fingerprint after the batch
+};
+
+// A script compiled the way every batch and multiplexed job runs it.
+struct CompiledScript {
+    AstArena arena;  // declared first so it outlives the statements
+    std::vector<std::unique_ptr<Stmt>> statements;
+    size_t globalSlots = 0;
+    std::string errors;  // what the Resolver reported
+    bool valid = true;
+};
+
+// Lexes, parses, optimizes, analyzes loops (from -O1) and resolves source into script. Errors are
+// collected in the script rather than written anywhere shared, so scripts can be compiled on any
+// thread.
+inline void compileScript(const std::string& source, int optimizationLevel, CompiledScript& script) {
+    Lexer lexer(source);
+    std::vector<Token> tokens = lexer.scanTokens();
+    Parser parser(tokens);
+    script.statements = parser.parse(script.arena);
+
+    // Names are checked before the optimizer can drop the code that uses them.
+    std::ostringstream errors;
+    Resolver resolver(errors);
+    if (optimizationLevel > 0 && !resolver.check(script.statements)) {
+        script.valid = false;
+        script.errors = errors.str();
+        return;
+    }
+
+    Optimizer optimizer(optimizationLevel);
+    optimizer.optimize(script.statements);
+    LoopAnalyzer loopAnalyzer(optimizationLevel >= 2);
+    if (optimizationLevel >= 1) {
+        loopAnalyzer.analyze(script.statements);
+    }
+
+    script.valid = resolver.resolve(script.statements);
+    script.errors = errors.str();
+    script.globalSlots = resolver.globalSlotCount();
+}
+
+class BatchRunner {
+public:
+    explicit BatchRunner(size_t threads = std::thread::hardware_concurrency(), int optimizationLevel = 1)
+        : threadCount(threads), optimizationLevel(optimizationLevel) {}
+
+    std::vector<BatchResult> run(const std::vector<BatchJob>& jobs) {
+        using Clock = std::chrono::steady_clock;
+        statistics = BatchStats();
+        statistics.jobs = jobs.size();
+
+        auto start = Clock::now();
+        std::vector<size_t> scriptOf = prepare(jobs);
+        statistics.scripts = scripts.size();
+        auto prepared = Clock::now();
+
+        std::vector<BatchResult> results(jobs.size());
+        WorkStealingPool pool(threadCount);
+        pool.run(jobs.size(), [&](size_t index) {
+            const Script& script = *scripts[scriptOf[index]];
+            BatchResult& result = results[index];
+            result.name = jobs[index].name;
+            result.errors = script.errors;
+            if (!script.valid) return;
+
+            std::ostringstream out;
+            std::ostringstream err;
+            {
+                Interpreter interpreter(out, FlushPolicy::ON_EXIT, err);
+                interpreter.interpret(script.statements);
+            }
+            result.output = out.str();
+            result.errors += err.str();
+        });
+        auto finished = Clock::now();
+
+        for (const auto& script : scripts) {
+            AstFingerprint fingerprint;
+            if (fingerprint.compute(script->statements) != script->fingerprint) {
+                statistics.astUnchanged = false;
+            }
+        }
+
+        statistics.threads = std::min(pool.threads(), std::max<size_t>(jobs.size(), 1));
+        statistics.steals = pool.steals();
+        statistics.prepareSeconds = std::chrono::duration<double>(prepared - start).count();
+        statistics.runSeconds = std::chrono::duration<double>(finished - prepared).count();
+        return results;
+    }
+
+    const BatchStats& stats() const { return statistics; }
+
+private:
+    // One parsed program, shared by every job with the same source.
+    struct Script : CompiledScript {
+        uint64_t fingerprint = 0;
+    };
+
+    size_t threadCount;
+    int optimizationLevel;
+    std::vector<std::unique_ptr<Script>> scripts;
+    BatchStats statistics;
+
+    // Parses, optimizes and resolves each distinct source once, on this thread, and returns
+    // the script index of every job.
+    std::vector<size_t> prepare(const std::vector<BatchJob>& jobs) {
+        scripts.clear();
+        std::unordered_map<std::string, size_t> bySource;
+        std::vector<size_t> scriptOf;
+        scriptOf.reserve(jobs.size());
+
+        for (const BatchJob& job : jobs) {
+            auto it = bySource.find(job.source);
+            if (it != bySource.end()) {
+                scriptOf.push_back(it->second);
+                continue;
+            }
+
+            auto script = std::make_unique<Script>();
+            compileScript(job.source, optimizationLevel, *script);
+
+            AstFingerprint fingerprint;
+            script->fingerprint = fingerprint.compute(script->statements);
+
+            bySource.emplace(job.source, scripts.size());
+            scriptOf.push_back(scripts.size());
+            scripts.push_back(std::move(script));
+        }
+        return scriptOf;
+    }
+};
+#endif
@@ -0,0 +1,474 @@
+#include "batch_runner.cpp"
+#include <chrono>
+#include <cstring>
+#include <unordered_set>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// 13. Row Batches (ColumnInterpreter)
+// Runs one resolved program for many rows of input at once. Every variable holds a column with
+// one double per row, so a single walk of the tree does the work of one Interpreter run per row.
+// Arithmetic and comparisons go through SIMD kernels: AVX2 when compiled with -mavx2, SSE2 on any
+// other x86-64 build, plain loops elsewhere. Control flow is handled with lane masks: an `if`
+// runs each branch for the rows that take it, and a `while` keeps running its body while any row
+// is still looping. A row whose program fails (division by zero) is dropped from every mask, so
+// like the Interpreter it stops at the error, and the other rows carry on.
+
+#ifndef BATCH_SIMD
+#define BATCH_SIMD
+
+// One lane-wide register worth of doubles. A mask lane is all ones (taken) or all zeros.
+#if defined(__AVX2__)
+struct SimdLanes {
+    using Vector = __m256d;
+    static constexpr size_t kWidth = 4;
+    static constexpr const char* kName = "AVX2";
+
+    static Vector load(const double* p) { return _mm256_loadu_pd(p); }
+    static void store(double* p, Vector v) { _mm256_storeu_pd(p, v); }
+    static Vector splat(double value) { return _mm256_set1_pd(value); }
+    static Vector add(Vector a, Vector b) { return _mm256_add_pd(a, b); }
+    static Vector sub(Vector a, Vector b) { return _mm256_sub_pd(a, b); }
+    static Vector mul(Vector a, Vector b) { return _mm256_mul_pd(a, b); }
+    static Vector div(Vector a, Vector b) { return _mm256_div_pd(a, b); }
+    static Vector greater(Vector a, Vector b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+    static Vector greaterEqual(Vector a, Vector b) { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+    static Vector less(Vector a, Vector b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    static Vector lessEqual(Vector a, Vector b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+    static Vector equal(Vector a, Vector b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+    static Vector notEqual(Vector a, Vector b) { return _mm256_cmp_pd(a, b, _CMP_NEQ_UQ); }
+    static Vector bitAnd(Vector a, Vector b) { return _mm256_and_pd(a, b); }
+    static Vector andNot(Vector a, Vector b) { return _mm256_andnot_pd(a, b); }  // ~a & b
+    static Vector blend(Vector a, Vector b, Vector mask) { return _mm256_blendv_pd(a, b, mask); }
+    static bool any(Vector mask) { return _mm256_movemask_pd(mask) != 0; }
+};
+#elif defined(__SSE2__)
+struct SimdLanes {
+    using Vector = __m128d;
+    static constexpr size_t kWidth = 2;
+    static constexpr const char* kName = "SSE2";
+
+    static Vector load(const double* p) { return _mm_loadu_pd(p); }
+    static void store(double* p, Vector v) { _mm_storeu_pd(p, v); }
+    static Vector splat(double value) { return _mm_set1_pd(value); }
+    static Vector add(Vector a, Vector b) { return _mm_add_pd(a, b); }
+    static Vector sub(Vector a, Vector b) { return _mm_sub_pd(a, b); }
+    static Vector mul(Vector a, Vector b) { return _mm_mul_pd(a, b); }
+    static Vector div(Vector a, Vector b) { return _mm_div_pd(a, b); }
+    static Vector greater(Vector a, Vector b) { return _mm_cmpgt_pd(a, b); }
+    static Vector greaterEqual(Vector a, Vector b) { return _mm_cmpge_pd(a, b); }
+    static Vector less(Vector a, Vector b) { return _mm_cmplt_pd(a, b); }
+    static Vector lessEqual(Vector a, Vector b) { return _mm_cmple_pd(a, b); }
+    static Vector equal(Vector a, Vector b) { return _mm_cmpeq_pd(a, b); }
+    static Vector notEqual(Vector a, Vector b) { return _mm_cmpneq_pd(a, b); }
+    static Vector bitAnd(Vector a, Vector b) { return _mm_and_pd(a, b); }
+    static Vector andNot(Vector a, Vector b) { return _mm_andnot_pd(a, b); }  // ~a & b
+    static Vector blend(Vector a, Vector b, Vector mask) {
+        return _mm_or_pd(_mm_and_pd(mask, b), _mm_andnot_pd(mask, a));
+    }
+    static bool any(Vector mask) { return _mm_movemask_pd(mask) != 0; }
+};
+#else
+struct SimdLanes {
+    using Vector = double;
+    static constexpr size_t kWidth = 1;
+    static constexpr const char* kName = "scalar";
+
+    static Vector load(const double* p) { return *p; }
+    static void store(double* p, Vector v) { *p = v; }
+    static Vector splat(double value) { return value; }
+    static Vector add(Vector a, Vector b) { return a + b; }
+    static Vector sub(Vector a, Vector b) { return a - b; }
+    static Vector mul(Vector a, Vector b) { return a * b; }
+    static Vector div(Vector a, Vector b) { return a / b; }
+    static Vector greater(Vector a, Vector b) { return fromBool(a > b); }
+    static Vector greaterEqual(Vector a, Vector b) { return fromBool(a >= b); }
+    static Vector less(Vector a, Vector b) { return fromBool(a < b); }
+    static Vector lessEqual(Vector a, Vector b) { return fromBool(a <= b); }
+    static Vector equal(Vector a, Vector b) { return fromBool(a == b); }
+    static Vector notEqual(Vector a, Vector b) { return fromBool(a != b); }
+    static Vector bitAnd(Vector a, Vector b) { return fromBits(bits(a) & bits(b)); }
+    static Vector andNot(Vector a, Vector b) { return fromBits(~bits(a) & bits(b)); }
+    static Vector blend(Vector a, Vector b, Vector mask) { return bits(mask) ? b : a; }
+    static bool any(Vector mask) { return bits(mask) != 0; }
+
+private:
+    static uint64_t bits(double value) {
+        uint64_t result;
+        std::memcpy(&result, &value, sizeof(result));
+        return result;
+    }
+    static double fromBits(uint64_t value) {
+        double result;
+        std::memcpy(&result, &value, sizeof(result));
+        return result;
+    }
+    static double fromBool(bool value) { return fromBits(value ? ~0ull : 0ull); }
+};
+#endif
+
+// Initial values of one top-level `let` variable, one per row.
+struct ColumnInput {
+    std::string name;
+    std::vector<double> values;
+};
+
+struct ColumnStats {
+    size_t rows = 0;
+    size_t failedRows = 0;
+    size_t lanes = SimdLanes::kWidth;
+    const char* kernel = SimdLanes::kName;
+    double seconds = 0;
+};
+
+class ColumnInterpreter : public ExprVisitor, public StmtVisitor {
+public:
+    // Runs a resolved program once per row, where row r starts every variable named in inputs
+    // with values[r] instead of its initializer. The initializer of such a variable is not run.
+    // Returns what each row printed and the runtime error it stopped at, if any.
+    std::vector<BatchResult> run(const std::vector<std::unique_ptr<Stmt>>& statements, size_t globalSlots,
+                                 const std::vector<ColumnInput>& inputs, size_t rows) {
+        auto start = std::chrono::steady_clock::now();
+        rowCount = rows;
+        // Rows are padded to a whole number of the widest vectors; the padding lanes start masked off.
+        width = (rows + kPadding - 1) / kPadding * kPadding;
+        statistics = ColumnStats();
+        statistics.rows = rows;
+
+        inputBySymbol.clear();
+        for (const ColumnInput& input : inputs) {
+            if (input.values.size() != rows) {
+                throw std::runtime_error("Input '" + input.name + "' has " + std::to_string(input.values.size()) +
+                                         " values for " + std::to_string(rows) + " rows");
+            }
+            inputBySymbol[SymbolTable::global().intern(input.name)] = &input.values;
+        }
+        // An input no top-level `let` declares would be ignored silently; reject it instead.
+        std::unordered_set<uint32_t> declared;
+        for (const auto& stmt : statements) {
+            if (stmt->kind == StmtKind::VARIABLE_DECLARATION) {
+                declared.insert(static_cast<const VariableDeclarationStmt&>(*stmt).name.symbol);
+            }
+        }
+        std::string unknown;
+        size_t unknownCount = 0;
+        for (const ColumnInput& input : inputs) {
+            if (!declared.count(SymbolTable::global().intern(input.name))) {
+                unknown += (unknownCount++ == 0 ? "'" : ", '") + input.name + "'";
+            }
+        }
+        if (unknownCount > 0) {
+            throw std::runtime_error((unknownCount == 1 ? "Input " + unknown + " matches" : "Inputs " + unknown + " match") +
+                                     " no top-level let");
+        }
+
+        results.assign(rows, BatchResult());
+        for (size_t row = 0; row < rows; ++row) results[row].name = "row " + std::to_string(row + 1);
+        slots.assign(globalSlots, Column(width, 0.0));
+        scopeBases.assign(1, 0);
+        top = globalSlots;
+        values.reset(width);
+        masks.reset(width);
+
+        double* all = masks.push();
+        for (size_t lane = 0; lane < width; ++lane) all[lane] = lane < rows ? allOnes() : 0.0;
+
+        for (const auto& stmt : statements) {
+            stmt->accept(*this);
+        }
+        masks.pop();
+
+        statistics.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return std::move(results);
+    }
+
+    const ColumnStats& stats() const { return statistics; }
+
+private:
+    using Column = std::vector<double>;
+    using Lanes = SimdLanes;
+
+    static constexpr size_t kPadding = 4;  // the widest kernel, so every width works
+
+    // A taken mask lane: every bit set.
+    static double allOnes() {
+        uint64_t bits = ~0ull;
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // A stack of columns that keeps its storage between pushes, so evaluation does not allocate.
+    struct ColumnStack {
+        std::vector<Column> columns;
+        size_t size = 0;
+        size_t width = 0;
+
+        void reset(size_t newWidth) {
+            if (newWidth != width) columns.clear();
+            width = newWidth;
+            size = 0;
+        }
+
+        double* push() {
+            if (size == columns.size()) columns.emplace_back(width, 0.0);
+            return columns[size++].data();
+        }
+
+        void pop() { size--; }
+        double* at(size_t index) { return columns[index].data(); }
+        double* back() { return columns[size - 1].data(); }
+    };
+
+    size_t rowCount = 0;
+    size_t width = 0;
+    std::unordered_map<uint32_t, const std::vector<double>*> inputBySymbol;
+    std::vector<BatchResult> results;
+    std::vector<Column> slots;       // one column per absolute slot
+    std::vector<size_t> scopeBases;  // first absolute slot of every enclosing scope
+    size_t top = 0;
+    ColumnStack values;              // operands of the expression being evaluated
+    ColumnStack masks;               // rows running the current statement, innermost last
+    ColumnStats statistics;
+
+    size_t absoluteSlot(int depth, int slot, const SymbolToken& name) {
+        if (slot < 0 || depth < 0 || static_cast<size_t>(depth) >= scopeBases.size()) {
+            throw std::runtime_error("Variable '" + std::string(name.lexeme) + "' at line " +
+                                     std::to_string(name.line) + " is not resolved");
+        }
+        size_t index = scopeBases[scopeBases.size() - 1 - depth] + slot;
+        if (index >= slots.size()) slots.resize(index + 1, Column(width, 0.0));
+        return index;
+    }
+
+    // Writes source into the active lanes of target.
+    void store(double* target, const double* source) {
+        const double* mask = masks.back();
+        for (size_t i = 0; i < width; i += Lanes::kWidth) {
+            Lanes::store(target + i, Lanes::blend(Lanes::load(target + i), Lanes::load(source + i), Lanes::load(mask + i)));
+        }
+    }
+
+    bool any(const double* mask) const {
+        for (size_t i = 0; i < width; i += Lanes::kWidth) {
+            if (Lanes::any(Lanes::load(mask + i))) return true;
+        }
+        return false;
+    }
+
+    // Stops every row in failed: records the error and takes it out of every mask.
+    void fail(const double* failed, const std::string& message) {
+        for (size_t lane = 0; lane < rowCount; ++lane) {
+            uint64_t bits;
+            std::memcpy(&bits, failed + lane, sizeof(bits));
+            if (!bits) continue;
+            results[lane].errors += "Runtime error: " + message + "\n";
+            statistics.failedRows++;
+        }
+        for (size_t level = 0; level < masks.size; ++level) {
+            double* mask = masks.at(level);
+            for (size_t i = 0; i < width; i += Lanes::kWidth) {
+                Lanes::store(mask + i, Lanes::andNot(Lanes::load(failed + i), Lanes::load(mask + i)));
+            }
+        }
+    }
+
+    // Pushes the rows of masks[base] for which condition is truthy (or, with truthy false, falsy).
+    void pushTruthy(const double* condition, bool truthy, size_t base) {
+        const double* current = masks.at(base);
+        double* mask = masks.push();
+        Lanes::Vector zero = Lanes::splat(0.0);
+        for (size_t i = 0; i < width; i += Lanes::kWidth) {
+            Lanes::Vector test = Lanes::notEqual(Lanes::load(condition + i), zero);
+            Lanes::Vector active = Lanes::load(current + i);
+            Lanes::store(mask + i, truthy ? Lanes::bitAnd(test, active) : Lanes::andNot(test, active));
+        }
+    }
+
+    // left = kernel(left, right), one vector at a time.
+    template <typename Kernel>
+    void binaryKernel(double* left, const double* right, Kernel kernel) {
+        for (size_t i = 0; i < width; i += Lanes::kWidth) {
+            Lanes::store(left + i, kernel(Lanes::load(left + i), Lanes::load(right + i)));
+        }
+    }
+
+    // Comparisons yield 1.0 or 0.0 like the Interpreter, not the raw lane mask.
+    template <typename Compare>
+    void compareKernel(double* left, const double* right, Compare compare) {
+        Lanes::Vector one = Lanes::splat(1.0);
+        binaryKernel(left, right, [&](Lanes::Vector a, Lanes::Vector b) { return Lanes::bitAnd(compare(a, b), one); });
+    }
+
+    // ExprVisitor implementations
+    void visitLiteralExpr(LiteralExpr& expr) override {
+        double* result = values.push();
+        std::fill(result, result + width, expr.value);
+    }
+
+    void visitVariableExpr(VariableExpr& expr) override {
+        const Column& slot = slots[absoluteSlot(expr.depth, expr.slot, expr.name)];
+        double* result = values.push();
+        std::copy(slot.begin(), slot.end(), result);
+    }
+
+    void visitUnaryExpr(UnaryExpr& expr) override {
+        expr.right->accept(*this);
+        double* value = values.back();
+        switch (expr.op.type) {
+            case TokenType::MINUS: {
+                Lanes::Vector signBit = Lanes::splat(-0.0);
+                for (size_t i = 0; i < width; i += Lanes::kWidth) {
+                    Lanes::store(value + i, Lanes::sub(signBit, Lanes::load(value + i)));
+                }
+                break;
+            }
+            case TokenType::BANG: {
+                Lanes::Vector zero = Lanes::splat(0.0);
+                Lanes::Vector one = Lanes::splat(1.0);
+                for (size_t i = 0; i < width; i += Lanes::kWidth) {
+                    Lanes::store(value + i, Lanes::bitAnd(Lanes::equal(Lanes::load(value + i), zero), one));
+                }
+                break;
+            }
+            default:
+                throw std::runtime_error("Unknown unary operator at line " + std::to_string(expr.op.line));
+        }
+    }
+
+    void visitBinaryExpr(BinaryExpr& expr) override {
+        expr.left->accept(*this);
+        expr.right->accept(*this);
+        double* left = values.at(values.size - 2);
+        const double* right = values.back();
+
+        if (expr.op.type == TokenType::SLASH) {
+            // Rows that would divide by zero stop here; the others still get a quotient.
+            double* zeros = values.push();
+            const double* active = masks.back();
+            Lanes::Vector zero = Lanes::splat(0.0);
+            for (size_t i = 0; i < width; i += Lanes::kWidth) {
+                Lanes::store(zeros + i, Lanes::bitAnd(Lanes::equal(Lanes::load(right + i), zero), Lanes::load(active + i)));
+            }
+            if (any(zeros)) {
+                fail(zeros, "Division by zero at line " + std::to_string(expr.op.line));
+            }
+            values.pop();
+        }
+
+        using V = Lanes::Vector;
+        switch (expr.op.type) {
+            case TokenType::PLUS: binaryKernel(left, right, [](V a, V b) { return Lanes::add(a, b); }); break;
+            case TokenType::MINUS: binaryKernel(left, right, [](V a, V b) { return Lanes::sub(a, b); }); break;
+            case TokenType::STAR: binaryKernel(left, right, [](V a, V b) { return Lanes::mul(a, b); }); break;
+            case TokenType::SLASH: binaryKernel(left, right, [](V a, V b) { return Lanes::div(a, b); }); break;
+            case TokenType::GREATER: compareKernel(left, right, [](V a, V b) { return Lanes::greater(a, b); }); break;
+            case TokenType::GREATER_EQUAL:
+                compareKernel(left, right, [](V a, V b) { return Lanes::greaterEqual(a, b); });
+                break;
+            case TokenType::LESS: compareKernel(left, right, [](V a, V b) { return Lanes::less(a, b); }); break;
+            case TokenType::LESS_EQUAL: compareKernel(left, right, [](V a, V b) { return Lanes::lessEqual(a, b); }); break;
+            case TokenType::EQUAL_EQUAL: compareKernel(left, right, [](V a, V b) { return Lanes::equal(a, b); }); break;
+            case TokenType::BANG_EQUAL: compareKernel(left, right, [](V a, V b) { return Lanes::notEqual(a, b); }); break;
+            default:
+                throw std::runtime_error("Unknown binary operator at line " + std::to_string(expr.op.line));
+        }
+        values.pop();
+    }
+
+    void visitAssignmentExpr(AssignmentExpr& expr) override {
+        expr.value->accept(*this);
+        store(slots[absoluteSlot(expr.depth, expr.slot, expr.name)].data(), values.back());
+    }
+
+    // StmtVisitor implementations
+    void visitExpressionStmt(ExpressionStmt& stmt) override {
+        stmt.expression->accept(*this);
+        values.pop();
+    }
+
+    void visitVariableDeclarationStmt(VariableDeclarationStmt& stmt) override {
+        size_t slot = absoluteSlot(0, stmt.slot, stmt.name);
+        auto input = scopeBases.size() == 1 ? inputBySymbol.find(stmt.name.symbol) : inputBySymbol.end();
+        if (input != inputBySymbol.end()) {
+            double* value = values.push();
+            std::copy(input->second->begin(), input->second->end(), value);
+        } else if (stmt.initializer) {
+            stmt.initializer->accept(*this);
+        } else {
+            double* value = values.push();
+            std::fill(value, value + width, 0.0);
+        }
+        store(slots[slot].data(), values.back());
+        values.pop();
+    }
+
+    void visitBlockStmt(BlockStmt& stmt) override {
+        if (stmt.slotCount < 0) {
+            throw std::runtime_error("Block at line " + std::to_string(stmt.line) + " is not resolved");
+        }
+        scopeBases.push_back(top);
+        top += stmt.slotCount;
+        for (const auto& statement : stmt.statements) {
+            statement->accept(*this);
+        }
+        top = scopeBases.back();
+        scopeBases.pop_back();
+    }
+
+    void visitIfStmt(IfStmt& stmt) override {
+        stmt.condition->accept(*this);
+        // Masks for the else rows (if any) and then the then rows, both taken from the current one.
+        size_t current = masks.size - 1;
+        if (stmt.elseBranch) pushTruthy(values.back(), false, current);
+        pushTruthy(values.back(), true, current);
+        values.pop();
+
+        if (any(masks.back())) stmt.thenBranch->accept(*this);
+        masks.pop();
+        if (stmt.elseBranch) {
+            if (any(masks.back())) stmt.elseBranch->accept(*this);
+            masks.pop();
+        }
+    }
+
+    void visitWhileStmt(WhileStmt& stmt) override {
+        // The mask pushed here holds the rows still looping; each check narrows it.
+        double* looping = masks.push();
+        std::copy(masks.at(masks.size - 2), masks.at(masks.size - 2) + width, looping);
+        for (;;) {
+            stmt.condition->accept(*this);
+            const double* condition = values.back();
+            double* mask = masks.back();
+            Lanes::Vector zero = Lanes::splat(0.0);
+            for (size_t i = 0; i < width; i += Lanes::kWidth) {
+                Lanes::store(mask + i, Lanes::bitAnd(Lanes::notEqual(Lanes::load(condition + i), zero),
+                                                     Lanes::load(mask + i)));
+            }
+            values.pop();
+            if (!any(mask)) break;
+            stmt.body->accept(*this);
+        }
+        masks.pop();
+    }
+
+    void visitPrintStmt(PrintStmt& stmt) override {
+        stmt.expression->accept(*this);
+        const double* value = values.back();
+        const double* mask = masks.back();
+        char text[OutputBuffer::kMaxNumberLength];
+        for (size_t lane = 0; lane < rowCount; ++lane) {
+            uint64_t bits;
+            std::memcpy(&bits, mask + lane, sizeof(bits));
+            if (!bits) continue;
+            results[lane].output.append(text, OutputBuffer::formatNumber(value[lane], text));
+        }
+        values.pop();
+    }
+};
+
+#endif
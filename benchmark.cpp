@@ -0,0 +1,251 @@
+// g++ -std=c++17 -O2 -o benchmark benchmark.cpp
+// ./benchmark [--repeat N] [--output FILE]
+//
+// Runs a corpus of synthetic workloads and times lexing, parsing, resolution and execution
+// separately. Results are printed as a table and written as JSON (default: bench_output.txt).
+
+#include "bytecode_vm.cpp"
+#include "flat_ast.cpp"
+#include "closure_compiler.cpp"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+
+// Allocation accounting: every operator new in this program goes through here.
+static size_t allocationCount = 0;
+static size_t allocationBytes = 0;
+
+void* operator new(size_t size) {
+    allocationCount++;
+    allocationBytes += size;
+    if (void* memory = std::malloc(size ? size : 1)) return memory;
+    throw std::bad_alloc();
+}
+
+// Kept out of line so the compiler does not pair the inlined free() with a builtin new.
+__attribute__((noinline)) void operator delete(void* memory) noexcept { std::free(memory); }
+__attribute__((noinline)) void operator delete(void* memory, size_t) noexcept { std::free(memory); }
+
+struct Workload {
+    std::string name;
+    std::string source;
+    size_t iterations;  // loop iterations (or executed statements) one run performs
+};
+
+struct PhaseResult {
+    std::string name;
+    std::string unit;
+    double seconds = 0;
+    double units = 0;
+    size_t allocations = 0;
+    size_t bytes = 0;
+
+    double throughput() const { return seconds > 0 ? units / seconds : 0; }
+};
+
+// Workload generators
+static Workload counterLoop(size_t n) {
+    return {"counter_loop",
+            "let i = 0;\nwhile (i < " + std::to_string(n) + ") {\n    i = i + 1;\n}\n",
+            n};
+}
+
+static Workload nestedBlocks(size_t depth, size_t n) {
+    std::string body;
+    for (size_t d = 0; d < depth; ++d) body += "{ let v = i + " + std::to_string(d) + ";\n";
+    body += "s = s + v;\n";
+    for (size_t d = 0; d < depth; ++d) body += "}\n";
+    return {"nested_blocks",
+            "let i = 0;\nlet s = 0;\nwhile (i < " + std::to_string(n) + ") {\n" + body + "i = i + 1;\n}\n",
+            n};
+}
+
+static Workload arithmeticChain(size_t terms, size_t n) {
+    std::string chain = "i";
+    const char* ops[] = {" + ", " * ", " - ", " / "};
+    for (size_t t = 1; t < terms; ++t) {
+        chain += ops[t % 4];
+        chain += std::to_string(t % 7 + 1);
+    }
+    return {"arithmetic_chain",
+            "let i = 0;\nlet x = 0;\nwhile (i < " + std::to_string(n) + ") {\n    x = " + chain +
+                ";\n    i = i + 1;\n}\n",
+            n};
+}
+
+static Workload flatProgram(size_t statements) {
+    std::string source;
+    for (size_t i = 0; i < statements; ++i) {
+        std::string name = "v" + std::to_string(i);
+        source += "let " + name + " = " + std::to_string(i) + ";\n" + name + " = " + name + " * 2 + 1;\n";
+    }
+    return {"flat_program", source, statements * 2};
+}
+
+static Workload printLoop(size_t n) {
+    return {"print_loop",
+            "let i = 0;\nwhile (i < " + std::to_string(n) + ") {\n    print i;\n    print i / 7;\n    i = i + 1;\n}\n",
+            n};
+}
+
+// Swallows program output so that printing cost, not terminal speed, is measured.
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+};
+
+// Runs fn `repeat` times and keeps the fastest run. setup, when given, runs before each
+// run outside the timed region, e.g. to tear down what the previous run built.
+static PhaseResult measure(const std::string& name, const std::string& unit, double units, int repeat,
+                           const std::function<void()>& fn, const std::function<void()>& setup = nullptr) {
+    PhaseResult result{name, unit};
+    result.units = units;
+    for (int r = 0; r < repeat; ++r) {
+        if (setup) {
+            setup();
+        }
+        size_t countBefore = allocationCount;
+        size_t bytesBefore = allocationBytes;
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (r == 0 || seconds < result.seconds) {
+            result.seconds = seconds;
+            result.allocations = allocationCount - countBefore;
+            result.bytes = allocationBytes - bytesBefore;
+        }
+    }
+    return result;
+}
+
+static std::vector<PhaseResult> runWorkload(const Workload& workload, int repeat, size_t& tokenCount, size_t& nodeCount) {
+    std::vector<PhaseResult> phases;
+
+    std::vector<Token> tokens;
+    phases.push_back(measure("lex", "tokens/s", 0, repeat, [&] {
+        Lexer lexer(workload.source);
+        tokens = lexer.scanTokens();
+    }, [&] { std::vector<Token>().swap(tokens); }));
+    tokenCount = tokens.size();
+    phases.back().units = static_cast<double>(tokenCount);
+
+    // Each parse gets a fresh arena; the last one is kept for the later phases. The previous
+    // tree and arena are released before the clock starts, so only building is measured.
+    std::unique_ptr<AstArena> arena;
+    std::vector<std::unique_ptr<Stmt>> statements;
+    phases.push_back(measure("parse", "nodes/s", 0, repeat, [&] {
+        arena = std::make_unique<AstArena>();
+        Parser parser(tokens);
+        statements = parser.parse(*arena);
+    }, [&] {
+        releaseTree(statements);
+        arena.reset();
+    }));
+    nodeCount = arena->nodeCount();
+    phases.back().units = static_cast<double>(nodeCount);
+
+    size_t globalSlots = 0;
+    phases.push_back(measure("resolve", "nodes/s", static_cast<double>(nodeCount), repeat, [&] {
+        Resolver resolver;
+        resolver.resolve(statements);
+        globalSlots = resolver.globalSlotCount();
+    }));
+
+    std::streambuf* coutBuffer = std::cout.rdbuf();
+    NullBuffer nullBuffer;
+    std::cout.rdbuf(&nullBuffer);
+    phases.push_back(measure("interpret", "iterations/s", static_cast<double>(workload.iterations), repeat, [&] {
+        Interpreter interpreter;
+        interpreter.interpret(statements);
+    }));
+
+    // The same program as closures; compiling them is not part of the measured run.
+    ClosureCompiler compiler;
+    ClosureProgram program = compiler.compile(statements, globalSlots);
+    phases.push_back(measure("closures", "iterations/s", static_cast<double>(workload.iterations), repeat, [&] {
+        ClosureEvaluator evaluator;
+        evaluator.interpret(program);
+    }));
+    std::cout.rdbuf(coutBuffer);
+
+    statements.clear();
+    return phases;
+}
+
+static std::string jsonEscape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+int main(int argc, char* argv[]) {
+    int repeat = 3;
+    std::string outputPath = "bench_output.txt";
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--repeat" && i + 1 < argc) repeat = std::max(1, std::atoi(argv[++i]));
+        if (arg == "--output" && i + 1 < argc) outputPath = argv[++i];
+    }
+
+    std::vector<Workload> workloads = {
+        counterLoop(1000000),
+        nestedBlocks(8, 100000),
+        arithmeticChain(64, 100000),
+        flatProgram(50000),
+        printLoop(200000),
+    };
+
+    std::ostringstream json;
+    json << std::fixed;
+    json << "{\n  \"repeat\": " << repeat << ",\n  \"workloads\": [\n";
+
+    std::cout << std::left << std::setw(18) << "workload" << std::setw(11) << "phase" << std::right
+              << std::setw(12) << "ms" << std::setw(16) << "throughput" << "  " << std::left << std::setw(14)
+              << "unit" << std::right << std::setw(12) << "allocs" << std::setw(14) << "bytes" << "\n";
+
+    for (size_t w = 0; w < workloads.size(); ++w) {
+        const Workload& workload = workloads[w];
+        size_t tokenCount = 0;
+        size_t nodeCount = 0;
+        std::vector<PhaseResult> phases = runWorkload(workload, repeat, tokenCount, nodeCount);
+
+        json << "    {\n      \"name\": \"" << jsonEscape(workload.name) << "\",\n"
+             << "      \"source_bytes\": " << workload.source.size() << ",\n"
+             << "      \"tokens\": " << tokenCount << ",\n"
+             << "      \"nodes\": " << nodeCount << ",\n"
+             << "      \"iterations\": " << workload.iterations << ",\n"
+             << "      \"phases\": {\n";
+
+        for (size_t p = 0; p < phases.size(); ++p) {
+            const PhaseResult& phase = phases[p];
+            std::cout << std::left << std::setw(18) << workload.name << std::setw(11) << phase.name << std::right
+                      << std::fixed << std::setprecision(3) << std::setw(12) << phase.seconds * 1000.0
+                      << std::setprecision(0) << std::setw(16) << phase.throughput() << "  " << std::left
+                      << std::setw(14) << phase.unit << std::right << std::setw(12) << phase.allocations
+                      << std::setw(14) << phase.bytes << "\n";
+
+            json << "        \"" << phase.name << "\": {\"seconds\": " << std::setprecision(9) << phase.seconds
+                 << ", \"throughput\": " << std::setprecision(1) << phase.throughput() << ", \"unit\": \""
+                 << phase.unit << "\", \"allocations\": " << phase.allocations << ", \"bytes\": " << phase.bytes
+                 << "}" << (p + 1 < phases.size() ? "," : "") << "\n";
+        }
+        json << "      }\n    }" << (w + 1 < workloads.size() ? "," : "") << "\n";
+    }
+    json << "  ]\n}\n";
+
+    std::ofstream output(outputPath);
+    output << json.str();
+    if (!output) {
+        std::cerr << "Could not write '" << outputPath << "'\n";
+        return 1;
+    }
+    std::cout << "Results written to " << outputPath << "\n";
+    return 0;
+}
@@ -0,0 +1,655 @@
+#include "enviroment_interpretation.cpp"
+#include <cstdint>
+#include <cstring>
+
+// 6. Bytecode Compilation (BytecodeCompiler)
+// The compiler lowers the AST into a flat chunk of bytecode. Variables are resolved
+// to slot indices at compile time, so the VM never looks up a name at runtime.
+// Common statement shapes (x = x + c, x = a op b, while (x < c)) are pattern-matched into
+// superinstructions that run in a single dispatch.
+
+#ifndef BYTECODE_VM
+#define BYTECODE_VM
+
+enum class OpCode : uint8_t {
+    CONSTANT,       // u32 constant index          push constants[i]
+    GET_LOCAL,      // u16 slot                    push slots[i]
+    SET_LOCAL,      // u16 slot                    slots[i] = top (value stays on the stack)
+    POP,            //                             drop top
+    NEGATE,
+    NOT,
+    ADD,
+    SUBTRACT,
+    MULTIPLY,
+    DIVIDE,
+    GREATER,
+    GREATER_EQUAL,
+    LESS,
+    LESS_EQUAL,
+    EQUAL,
+    NOT_EQUAL,
+    PRINT,          //                             pop and print
+    JUMP,           // u32 target offset
+    JUMP_IF_FALSE,  // u32 target offset           pop, jump when falsy
+    UNDEFINED,      // u16 name index              raise "Undefined variable"
+    RETURN,
+    // Superinstructions; op operands hold the OpCode of the fused arithmetic or comparison.
+    ADD_LOCAL_CONST,          // u16 slot, u32 constant          slots[i] += constants[c]
+    BINARY_LOCALS,            // u8 op, u16 target, u16 a, u16 b  slots[t] = slots[a] op slots[b]
+    JUMP_UNLESS_LOCAL_CONST,  // u8 op, u16 slot, u32 constant, u32 target
+                              //                                 jump unless slots[i] op constants[c]
+    COUNT
+};
+
+// A compiled program: the instruction stream plus everything it refers to.
+struct Chunk {
+    std::vector<uint8_t> code;
+    std::vector<int> lines;          // source line of every byte in code, for runtime errors
+    std::vector<double> constants;
+    std::vector<std::string> names;  // names of variables that could not be resolved
+    size_t slotCount = 0;
+    size_t maxStack = 0;
+};
+
+// How many statements and loop/branch conditions were turned into superinstructions.
+struct FusionStats {
+    size_t candidates = 0;     // expression statements plus if/while conditions
+    size_t addLocalConst = 0;
+    size_t binaryLocals = 0;
+    size_t compareJumps = 0;
+
+    size_t fused() const { return addLocalConst + binaryLocals + compareJumps; }
+};
+
+class BytecodeCompiler : public ExprVisitor, public StmtVisitor {
+public:
+    explicit BytecodeCompiler(bool fuse = true) : fuse(fuse) {}
+
+    Chunk compile(const std::vector<std::unique_ptr<Stmt>>& statements) {
+        reset();
+        for (const auto& stmt : statements) {
+            stmt->accept(*this);
+        }
+        emitOp(OpCode::RETURN);
+        return std::move(chunk);
+    }
+
+    // Compiles a single loop on its own. Each name in inputs, a variable the loop uses but does not
+    // declare, becomes local slot i in order, for the caller to fill before the run and read after.
+    Chunk compileLoop(WhileStmt& loop, const std::vector<SymbolToken>& inputs) {
+        reset();
+        for (const SymbolToken& input : inputs) {
+            declareLocal(input);
+        }
+        loop.accept(*this);
+        emitOp(OpCode::RETURN);
+        return std::move(chunk);
+    }
+
+    const FusionStats& fusionStats() const { return stats; }
+
+private:
+    struct Local {
+        uint32_t symbol;
+        int depth;
+        uint16_t slot;
+    };
+
+    bool fuse;
+    FusionStats stats;
+    Chunk chunk;
+    std::vector<Local> locals;
+    int scopeDepth = 0;
+    size_t nextSlot = 0;
+    size_t stackDepth = 0;
+    int line = 0;
+
+    void reset() {
+        chunk = Chunk();
+        locals.clear();
+        scopeDepth = 0;
+        nextSlot = 0;
+        stackDepth = 0;
+        stats = FusionStats();
+    }
+
+    // Emission helpers
+    void emitByte(uint8_t byte) {
+        chunk.code.push_back(byte);
+        chunk.lines.push_back(line);
+    }
+
+    void emitOp(OpCode op) {
+        emitByte(static_cast<uint8_t>(op));
+        adjustStack(op);
+    }
+
+    void emitU16(uint16_t value) {
+        emitByte(static_cast<uint8_t>(value & 0xff));
+        emitByte(static_cast<uint8_t>(value >> 8));
+    }
+
+    void emitU32(uint32_t value) {
+        uint8_t bytes[sizeof(value)];
+        std::memcpy(bytes, &value, sizeof(value));
+        for (uint8_t byte : bytes) {
+            emitByte(byte);
+        }
+    }
+
+    void emitConstant(double value) {
+        emitOp(OpCode::CONSTANT);
+        emitU32(makeConstant(value));
+    }
+
+    size_t emitJump(OpCode op) {
+        emitOp(op);
+        size_t operand = chunk.code.size();
+        emitU32(0);
+        return operand;
+    }
+
+    void patchJump(size_t operand, size_t target) {
+        uint32_t value = static_cast<uint32_t>(target);
+        std::memcpy(&chunk.code[operand], &value, sizeof(value));
+    }
+
+    uint32_t makeConstant(double value) {
+        for (size_t i = 0; i < chunk.constants.size(); ++i) {
+            if (std::memcmp(&chunk.constants[i], &value, sizeof(double)) == 0) {
+                return static_cast<uint32_t>(i);
+            }
+        }
+        chunk.constants.push_back(value);
+        return static_cast<uint32_t>(chunk.constants.size() - 1);
+    }
+
+    // Track the operand stack height so the VM can size its stack once.
+    void adjustStack(OpCode op) {
+        switch (op) {
+            case OpCode::CONSTANT:
+            case OpCode::GET_LOCAL:
+            case OpCode::UNDEFINED:
+                stackDepth++;
+                break;
+            case OpCode::POP:
+            case OpCode::PRINT:
+            case OpCode::JUMP_IF_FALSE:
+            case OpCode::ADD:
+            case OpCode::SUBTRACT:
+            case OpCode::MULTIPLY:
+            case OpCode::DIVIDE:
+            case OpCode::GREATER:
+            case OpCode::GREATER_EQUAL:
+            case OpCode::LESS:
+            case OpCode::LESS_EQUAL:
+            case OpCode::EQUAL:
+            case OpCode::NOT_EQUAL:
+                stackDepth--;
+                break;
+            default:
+                break;
+        }
+        chunk.maxStack = std::max(chunk.maxStack, stackDepth);
+    }
+
+    // Scopes
+    void beginScope() {
+        scopeDepth++;
+    }
+
+    void endScope() {
+        while (!locals.empty() && locals.back().depth == scopeDepth) {
+            locals.pop_back();
+        }
+        scopeDepth--;
+        nextSlot = locals.empty() ? 0 : locals.back().slot + 1;
+    }
+
+    int resolveLocal(uint32_t symbol) {
+        for (size_t i = locals.size(); i > 0; --i) {
+            if (locals[i - 1].symbol == symbol) return locals[i - 1].slot;
+        }
+        return -1;
+    }
+
+    uint16_t declareLocal(const SymbolToken& name) {
+        // Redeclaring a name in the same scope overwrites it, like Environment::define.
+        for (size_t i = locals.size(); i > 0 && locals[i - 1].depth == scopeDepth; --i) {
+            if (locals[i - 1].symbol == name.symbol) return locals[i - 1].slot;
+        }
+        if (nextSlot > UINT16_MAX) {
+            throw std::runtime_error("Too many variables in scope at line " + std::to_string(name.line));
+        }
+        uint16_t slot = static_cast<uint16_t>(nextSlot++);
+        locals.push_back({name.symbol, scopeDepth, slot});
+        chunk.slotCount = std::max(chunk.slotCount, nextSlot);
+        return slot;
+    }
+
+    void emitVariable(const SymbolToken& name, OpCode op) {
+        line = name.line;
+        int slot = resolveLocal(name.symbol);
+        if (slot < 0) {
+            // The tree-walker only reports an unknown name when it is reached, so do the same.
+            chunk.names.emplace_back(name.lexeme);
+            emitOp(OpCode::UNDEFINED);
+            emitU16(static_cast<uint16_t>(chunk.names.size() - 1));
+            if (op == OpCode::SET_LOCAL) stackDepth--;
+            return;
+        }
+        emitOp(op);
+        emitU16(static_cast<uint16_t>(slot));
+    }
+
+    // Superinstructions
+    static bool isArithmetic(TokenType type) {
+        return type == TokenType::PLUS || type == TokenType::MINUS || type == TokenType::STAR ||
+               type == TokenType::SLASH;
+    }
+
+    static OpCode opcodeFor(TokenType type) {
+        switch (type) {
+            case TokenType::PLUS: return OpCode::ADD;
+            case TokenType::MINUS: return OpCode::SUBTRACT;
+            case TokenType::STAR: return OpCode::MULTIPLY;
+            case TokenType::SLASH: return OpCode::DIVIDE;
+            case TokenType::GREATER: return OpCode::GREATER;
+            case TokenType::GREATER_EQUAL: return OpCode::GREATER_EQUAL;
+            case TokenType::LESS: return OpCode::LESS;
+            case TokenType::LESS_EQUAL: return OpCode::LESS_EQUAL;
+            case TokenType::EQUAL_EQUAL: return OpCode::EQUAL;
+            case TokenType::BANG_EQUAL: return OpCode::NOT_EQUAL;
+            default: return OpCode::COUNT;
+        }
+    }
+
+    // The comparison that gives the same answer with its operands swapped (c < x is x > c).
+    static OpCode mirrored(OpCode op) {
+        switch (op) {
+            case OpCode::GREATER: return OpCode::LESS;
+            case OpCode::GREATER_EQUAL: return OpCode::LESS_EQUAL;
+            case OpCode::LESS: return OpCode::GREATER;
+            case OpCode::LESS_EQUAL: return OpCode::GREATER_EQUAL;
+            default: return op;
+        }
+    }
+
+    int localSlot(Expr& expr) {
+        auto variable = dynamic_cast<VariableExpr*>(&expr);
+        return variable ? resolveLocal(variable->name.symbol) : -1;
+    }
+
+    // Compiles `x = x + c`, `x = c + x`, `x = x - c` or `x = a op b` as one instruction
+    // with no operand stack traffic. Returns false when the statement has another shape.
+    bool fuseAssignment(Expr& expression) {
+        auto assignment = dynamic_cast<AssignmentExpr*>(&expression);
+        if (!assignment) return false;
+        auto binary = dynamic_cast<BinaryExpr*>(assignment->value.get());
+        int target = resolveLocal(assignment->name.symbol);
+        if (!binary || target < 0 || !isArithmetic(binary->op.type)) return false;
+
+        TokenType type = binary->op.type;
+        auto leftLiteral = dynamic_cast<LiteralExpr*>(binary->left.get());
+        auto rightLiteral = dynamic_cast<LiteralExpr*>(binary->right.get());
+        int left = localSlot(*binary->left);
+        int right = localSlot(*binary->right);
+
+        // x - c is exactly x + (-c) in IEEE arithmetic.
+        double increment = 0;
+        bool isIncrement = false;
+        if (left == target && rightLiteral && (type == TokenType::PLUS || type == TokenType::MINUS)) {
+            increment = type == TokenType::PLUS ? rightLiteral->value : -rightLiteral->value;
+            isIncrement = true;
+        } else if (right == target && leftLiteral && type == TokenType::PLUS) {
+            increment = leftLiteral->value;
+            isIncrement = true;
+        }
+
+        line = binary->op.line;
+        if (isIncrement) {
+            emitOp(OpCode::ADD_LOCAL_CONST);
+            emitU16(static_cast<uint16_t>(target));
+            emitU32(makeConstant(increment));
+            stats.addLocalConst++;
+            return true;
+        }
+        if (left >= 0 && right >= 0) {
+            emitOp(OpCode::BINARY_LOCALS);
+            emitByte(static_cast<uint8_t>(opcodeFor(type)));
+            emitU16(static_cast<uint16_t>(target));
+            emitU16(static_cast<uint16_t>(left));
+            emitU16(static_cast<uint16_t>(right));
+            stats.binaryLocals++;
+            return true;
+        }
+        return false;
+    }
+
+    // Compiles a `x op c` (or `c op x`) comparison used as a condition into a single
+    // compare-and-branch. Returns the jump operand to patch, or 0 when it does not apply.
+    size_t fuseCondition(Expr& condition) {
+        auto binary = dynamic_cast<BinaryExpr*>(&condition);
+        if (!binary) return 0;
+        OpCode op = opcodeFor(binary->op.type);
+        if (op == OpCode::COUNT || isArithmetic(binary->op.type)) return 0;
+
+        int slot = localSlot(*binary->left);
+        auto literal = dynamic_cast<LiteralExpr*>(binary->right.get());
+        if (slot < 0 || !literal) {
+            slot = localSlot(*binary->right);
+            literal = dynamic_cast<LiteralExpr*>(binary->left.get());
+            op = mirrored(op);
+        }
+        if (slot < 0 || !literal) return 0;
+
+        line = binary->op.line;
+        emitOp(OpCode::JUMP_UNLESS_LOCAL_CONST);
+        emitByte(static_cast<uint8_t>(op));
+        emitU16(static_cast<uint16_t>(slot));
+        emitU32(makeConstant(literal->value));
+        size_t operand = chunk.code.size();
+        emitU32(0);
+        stats.compareJumps++;
+        return operand;
+    }
+
+    size_t emitConditionJump(Expr& condition) {
+        stats.candidates++;
+        if (fuse) {
+            if (size_t operand = fuseCondition(condition)) return operand;
+        }
+        condition.accept(*this);
+        return emitJump(OpCode::JUMP_IF_FALSE);
+    }
+
+    // ExprVisitor implementations
+    void visitLiteralExpr(LiteralExpr& expr) override {
+        emitConstant(expr.value);
+    }
+
+    void visitVariableExpr(VariableExpr& expr) override {
+        emitVariable(expr.name, OpCode::GET_LOCAL);
+    }
+
+    void visitUnaryExpr(UnaryExpr& expr) override {
+        expr.right->accept(*this);
+        line = expr.op.line;
+        switch (expr.op.type) {
+            case TokenType::MINUS: emitOp(OpCode::NEGATE); break;
+            case TokenType::BANG: emitOp(OpCode::NOT); break;
+            default:
+                throw std::runtime_error("Unknown unary operator at line " + std::to_string(expr.op.line));
+        }
+    }
+
+    void visitBinaryExpr(BinaryExpr& expr) override {
+        expr.left->accept(*this);
+        expr.right->accept(*this);
+        line = expr.op.line;
+        switch (expr.op.type) {
+            case TokenType::PLUS: emitOp(OpCode::ADD); break;
+            case TokenType::MINUS: emitOp(OpCode::SUBTRACT); break;
+            case TokenType::STAR: emitOp(OpCode::MULTIPLY); break;
+            case TokenType::SLASH: emitOp(OpCode::DIVIDE); break;
+            case TokenType::GREATER: emitOp(OpCode::GREATER); break;
+            case TokenType::GREATER_EQUAL: emitOp(OpCode::GREATER_EQUAL); break;
+            case TokenType::LESS: emitOp(OpCode::LESS); break;
+            case TokenType::LESS_EQUAL: emitOp(OpCode::LESS_EQUAL); break;
+            case TokenType::EQUAL_EQUAL: emitOp(OpCode::EQUAL); break;
+            case TokenType::BANG_EQUAL: emitOp(OpCode::NOT_EQUAL); break;
+            default:
+                throw std::runtime_error("Unknown binary operator at line " + std::to_string(expr.op.line));
+        }
+    }
+
+    void visitAssignmentExpr(AssignmentExpr& expr) override {
+        expr.value->accept(*this);
+        emitVariable(expr.name, OpCode::SET_LOCAL);
+    }
+
+    // StmtVisitor implementations
+    void visitExpressionStmt(ExpressionStmt& stmt) override {
+        stats.candidates++;
+        if (fuse && fuseAssignment(*stmt.expression)) return;
+        stmt.expression->accept(*this);
+        emitOp(OpCode::POP);
+    }
+
+    void visitVariableDeclarationStmt(VariableDeclarationStmt& stmt) override {
+        if (stmt.initializer) {
+            stmt.initializer->accept(*this);
+        } else {
+            emitConstant(0.0);
+        }
+        line = stmt.name.line;
+        uint16_t slot = declareLocal(stmt.name);
+        emitOp(OpCode::SET_LOCAL);
+        emitU16(slot);
+        emitOp(OpCode::POP);
+    }
+
+    void visitBlockStmt(BlockStmt& stmt) override {
+        beginScope();
+        for (const auto& statement : stmt.statements) {
+            statement->accept(*this);
+        }
+        endScope();
+    }
+
+    void visitIfStmt(IfStmt& stmt) override {
+        size_t elseJump = emitConditionJump(*stmt.condition);
+        stmt.thenBranch->accept(*this);
+        if (stmt.elseBranch) {
+            size_t endJump = emitJump(OpCode::JUMP);
+            patchJump(elseJump, chunk.code.size());
+            stmt.elseBranch->accept(*this);
+            patchJump(endJump, chunk.code.size());
+        } else {
+            patchJump(elseJump, chunk.code.size());
+        }
+    }
+
+    void visitWhileStmt(WhileStmt& stmt) override {
+        size_t loopStart = chunk.code.size();
+        size_t exitJump = emitConditionJump(*stmt.condition);
+        stmt.body->accept(*this);
+        size_t backJump = emitJump(OpCode::JUMP);
+        patchJump(backJump, loopStart);
+        patchJump(exitJump, chunk.code.size());
+    }
+
+    void visitPrintStmt(PrintStmt& stmt) override {
+        stmt.expression->accept(*this);
+        emitOp(OpCode::PRINT);
+    }
+};
+
+// 7. Virtual Machine (VM)
+// The VM runs a compiled chunk with one dispatch loop over a flat operand stack.
+// GCC and Clang use computed goto (threaded dispatch); other compilers fall back to a switch.
+
+#if defined(__GNUC__) || defined(__clang__)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+class VM {
+public:
+    VM(std::ostream& out = std::cout, FlushPolicy policy = FlushPolicy::THRESHOLD, bool fuse = true,
+       std::ostream& err = std::cerr)
+        : output(out, policy), errors(&err), fuse(fuse) {}
+
+    void interpret(const std::vector<std::unique_ptr<Stmt>>& statements) {
+        try {
+            BytecodeCompiler compiler(fuse);
+            Chunk chunk = compiler.compile(statements);
+            stats = compiler.fusionStats();
+            run(chunk);
+        } catch (const std::runtime_error& error) {
+            output.flush();
+            *errors << "Runtime error: " << error.what() << "\n";
+        }
+        output.flush();
+    }
+
+    void run(const Chunk& chunk) {
+        std::vector<double> slots(chunk.slotCount, 0.0);
+        run(chunk, slots, output);
+    }
+
+    // Runs chunk on slots, whose leading entries the caller may have preset, printing through out.
+    // The slots keep their final values, so the caller can read them back.
+    void run(const Chunk& chunk, std::vector<double>& slots, OutputBuffer& out) {
+        if (slots.size() < chunk.slotCount) slots.resize(chunk.slotCount, 0.0);
+        std::vector<double> stack(chunk.maxStack + 1);
+
+        const uint8_t* code = chunk.code.data();
+        const uint8_t* ip = code;
+        const double* constants = chunk.constants.data();
+        double* locals = slots.data();
+        double* sp = stack.data();
+
+#define VM_READ_U16() (ip += 2, static_cast<uint16_t>(ip[-2] | (ip[-1] << 8)))
+#define VM_READ_U32() (ip += 4, readU32(ip - 4))
+#define VM_BINARY(expr) { double right = *--sp; double left = sp[-1]; sp[-1] = (expr); VM_DISPATCH(); }
+
+#ifdef VM_COMPUTED_GOTO
+        static void* dispatchTable[] = {
+            &&label_CONSTANT, &&label_GET_LOCAL, &&label_SET_LOCAL, &&label_POP,
+            &&label_NEGATE, &&label_NOT,
+            &&label_ADD, &&label_SUBTRACT, &&label_MULTIPLY, &&label_DIVIDE,
+            &&label_GREATER, &&label_GREATER_EQUAL, &&label_LESS, &&label_LESS_EQUAL,
+            &&label_EQUAL, &&label_NOT_EQUAL,
+            &&label_PRINT, &&label_JUMP, &&label_JUMP_IF_FALSE, &&label_UNDEFINED, &&label_RETURN,
+            &&label_ADD_LOCAL_CONST, &&label_BINARY_LOCALS, &&label_JUMP_UNLESS_LOCAL_CONST
+        };
+        static_assert(sizeof(dispatchTable) / sizeof(dispatchTable[0]) == static_cast<size_t>(OpCode::COUNT),
+                      "dispatch table out of sync with OpCode");
+#define VM_DISPATCH() goto *dispatchTable[*ip++]
+#define VM_CASE(op) label_##op:
+        VM_DISPATCH();
+#else
+#define VM_DISPATCH() continue
+#define VM_CASE(op) case OpCode::op:
+        for (;;) {
+            switch (static_cast<OpCode>(*ip++)) {
+#endif
+        VM_CASE(CONSTANT) { *sp++ = constants[VM_READ_U32()]; VM_DISPATCH(); }
+        VM_CASE(GET_LOCAL) { *sp++ = locals[VM_READ_U16()]; VM_DISPATCH(); }
+        VM_CASE(SET_LOCAL) { locals[VM_READ_U16()] = sp[-1]; VM_DISPATCH(); }
+        VM_CASE(POP) { --sp; VM_DISPATCH(); }
+        VM_CASE(NEGATE) { sp[-1] = -sp[-1]; VM_DISPATCH(); }
+        VM_CASE(NOT) { sp[-1] = isTruthy(sp[-1]) ? 0.0 : 1.0; VM_DISPATCH(); }
+        VM_CASE(ADD) VM_BINARY(left + right)
+        VM_CASE(SUBTRACT) VM_BINARY(left - right)
+        VM_CASE(MULTIPLY) VM_BINARY(left * right)
+        VM_CASE(DIVIDE) {
+            double right = *--sp;
+            if (right == 0) {
+                throw std::runtime_error("Division by zero at line " + std::to_string(lineAt(chunk, ip)));
+            }
+            sp[-1] = sp[-1] / right;
+            VM_DISPATCH();
+        }
+        VM_CASE(GREATER) VM_BINARY(left > right ? 1.0 : 0.0)
+        VM_CASE(GREATER_EQUAL) VM_BINARY(left >= right ? 1.0 : 0.0)
+        VM_CASE(LESS) VM_BINARY(left < right ? 1.0 : 0.0)
+        VM_CASE(LESS_EQUAL) VM_BINARY(left <= right ? 1.0 : 0.0)
+        VM_CASE(EQUAL) VM_BINARY(left == right ? 1.0 : 0.0)
+        VM_CASE(NOT_EQUAL) VM_BINARY(left != right ? 1.0 : 0.0)
+        VM_CASE(PRINT) { out.printNumber(*--sp); VM_DISPATCH(); }
+        VM_CASE(JUMP) { ip = code + readU32(ip); VM_DISPATCH(); }
+        VM_CASE(JUMP_IF_FALSE) {
+            uint32_t target = VM_READ_U32();
+            if (!isTruthy(*--sp)) ip = code + target;
+            VM_DISPATCH();
+        }
+        VM_CASE(UNDEFINED) {
+            uint16_t name = VM_READ_U16();
+            throw std::runtime_error("Undefined variable '" + chunk.names[name] +
+                                     "' at line " + std::to_string(lineAt(chunk, ip)));
+        }
+        VM_CASE(RETURN) { return; }
+        VM_CASE(ADD_LOCAL_CONST) {
+            uint16_t slot = VM_READ_U16();
+            locals[slot] += constants[VM_READ_U32()];
+            VM_DISPATCH();
+        }
+        VM_CASE(BINARY_LOCALS) {
+            OpCode op = static_cast<OpCode>(*ip++);
+            uint16_t target = VM_READ_U16();
+            uint16_t left = VM_READ_U16();
+            uint16_t right = VM_READ_U16();
+            locals[target] = arithmetic(op, locals[left], locals[right], chunk, ip);
+            VM_DISPATCH();
+        }
+        VM_CASE(JUMP_UNLESS_LOCAL_CONST) {
+            OpCode op = static_cast<OpCode>(*ip++);
+            uint16_t slot = VM_READ_U16();
+            double constant = constants[VM_READ_U32()];
+            uint32_t target = VM_READ_U32();
+            if (!compare(op, locals[slot], constant)) ip = code + target;
+            VM_DISPATCH();
+        }
+#ifndef VM_COMPUTED_GOTO
+            default:
+                throw std::runtime_error("Unknown opcode in chunk");
+            }
+        }
+#endif
+
+#undef VM_READ_U16
+#undef VM_READ_U32
+#undef VM_BINARY
+#undef VM_DISPATCH
+#undef VM_CASE
+    }
+
+    // Fusion statistics of the last program compiled by interpret().
+    const FusionStats& fusionStats() const { return stats; }
+
+private:
+    OutputBuffer output;
+    std::ostream* errors;
+    bool fuse;
+    FusionStats stats;
+
+    static double arithmetic(OpCode op, double left, double right, const Chunk& chunk, const uint8_t* ip) {
+        switch (op) {
+            case OpCode::ADD: return left + right;
+            case OpCode::SUBTRACT: return left - right;
+            case OpCode::MULTIPLY: return left * right;
+            default:
+                if (right == 0) {
+                    throw std::runtime_error("Division by zero at line " + std::to_string(lineAt(chunk, ip)));
+                }
+                return left / right;
+        }
+    }
+
+    static bool compare(OpCode op, double left, double right) {
+        switch (op) {
+            case OpCode::GREATER: return left > right;
+            case OpCode::GREATER_EQUAL: return left >= right;
+            case OpCode::LESS: return left < right;
+            case OpCode::LESS_EQUAL: return left <= right;
+            case OpCode::EQUAL: return left == right;
+            default: return left != right;
+        }
+    }
+
+    static uint32_t readU32(const uint8_t* bytes) {
+        uint32_t value;
+        std::memcpy(&value, bytes, sizeof(value));
+        return value;
+    }
+
+    static int lineAt(const Chunk& chunk, const uint8_t* ip) {
+        return chunk.lines[ip - chunk.code.data() - 1];
+    }
+
+    static bool isTruthy(double value) {
+        return value != 0.0;
+    }
+};
+#endif
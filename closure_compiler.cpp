@@ -0,0 +1,308 @@
+#include "enviroment_interpretation.cpp"
+#include <functional>
+
+// 17. Closure Compilation (ClosureCompiler, ClosureEvaluator)
+// Walks a resolved program once and turns every node into a closure specialized for its kind,
+// its operator and the shape of its operands. Variables are bound to fixed indices in one array
+// of slots: a block's scope never outlives the block, so each scope can sit right above the
+// scope that encloses it. `a + b` over two variables becomes one closure that loads both slots
+// and adds them, `i < 100` one that compares a slot with a constant, and `i = i + 1` one that
+// also stores the sum. Running the program is calling the closures, with values returned
+// directly: no visitor dispatch, value stack or operator switch is left at run time.
+
+#ifndef CLOSURE_COMPILER
+#define CLOSURE_COMPILER
+
+// What every closure runs against.
+struct ClosureState {
+    double* slots;
+    OutputBuffer& output;
+};
+
+using ExprClosure = std::function<double(ClosureState&)>;
+using StmtClosure = std::function<void(ClosureState&)>;
+
+struct ClosureProgram {
+    std::vector<StmtClosure> statements;
+    size_t slotCount = 0;  // globals plus the deepest nesting of block scopes
+    size_t closures = 0;
+};
+
+// Converts a resolved pointer tree into a ClosureProgram.
+class ClosureCompiler : public ExprVisitor, public StmtVisitor {
+public:
+    ClosureProgram compile(const std::vector<std::unique_ptr<Stmt>>& statements, size_t globalSlots) {
+        program = ClosureProgram();
+        scopes.assign(1, Scope{0, globalSlots});
+        program.slotCount = globalSlots;
+        for (const auto& stmt : statements) {
+            program.statements.push_back(compile(*stmt));
+        }
+        return std::move(program);
+    }
+
+private:
+    // Where a scope's slots start in the slot array, and how many it has.
+    struct Scope {
+        size_t base;
+        size_t size;
+    };
+
+    ClosureProgram program;
+    std::vector<Scope> scopes;  // innermost last
+    ExprClosure expression;
+    StmtClosure statement;
+
+    // Binary operators, each applied inline by the closures that use it.
+    struct Add { static double apply(double a, double b, int) { return a + b; } };
+    struct Subtract { static double apply(double a, double b, int) { return a - b; } };
+    struct Multiply { static double apply(double a, double b, int) { return a * b; } };
+    struct Divide {
+        static double apply(double a, double b, int line) {
+            if (b == 0) {
+                throw std::runtime_error("Division by zero at line " + std::to_string(line));
+            }
+            return a / b;
+        }
+    };
+    struct Greater { static double apply(double a, double b, int) { return a > b ? 1.0 : 0.0; } };
+    struct GreaterEqual { static double apply(double a, double b, int) { return a >= b ? 1.0 : 0.0; } };
+    struct Less { static double apply(double a, double b, int) { return a < b ? 1.0 : 0.0; } };
+    struct LessEqual { static double apply(double a, double b, int) { return a <= b ? 1.0 : 0.0; } };
+    struct Equal { static double apply(double a, double b, int) { return a == b ? 1.0 : 0.0; } };
+    struct NotEqual { static double apply(double a, double b, int) { return a != b ? 1.0 : 0.0; } };
+
+    ExprClosure compile(Expr& expr) {
+        expr.accept(*this);
+        program.closures++;
+        return std::move(expression);
+    }
+
+    StmtClosure compile(Stmt& stmt) {
+        stmt.accept(*this);
+        program.closures++;
+        return std::move(statement);
+    }
+
+    // The index in the slot array of a resolved variable, seen from the innermost scope.
+    size_t slot(int depth, int index, const SymbolToken& name) const {
+        if (index < 0 || depth < 0 || static_cast<size_t>(depth) >= scopes.size()) {
+            throw std::runtime_error("Variable '" + std::string(name.lexeme) + "' at line " + std::to_string(name.line) +
+                                     " was not resolved before closure compilation");
+        }
+        return scopes[scopes.size() - 1 - depth].base + static_cast<size_t>(index);
+    }
+
+    // The slot a variable reference reads, or -1 for any other expression.
+    long variableSlot(Expr& expr) const {
+        auto variable = dynamic_cast<VariableExpr*>(&expr);
+        return variable ? static_cast<long>(slot(variable->depth, variable->slot, variable->name)) : -1;
+    }
+
+    // Returns kernel as is, or wrapped so that its result is also stored in target.
+    template <typename Kernel>
+    static ExprClosure store(Kernel kernel, long target) {
+        if (target < 0) return kernel;
+        size_t index = static_cast<size_t>(target);
+        return [kernel, index](ClosureState& state) { return state.slots[index] = kernel(state); };
+    }
+
+    // Picks the closure for `left op right` from the operand shapes. The left operand is always
+    // evaluated before the right one, as in the Interpreter.
+    template <typename Op>
+    ExprClosure binary(BinaryExpr& expr, long target) {
+        int line = expr.op.line;
+        long left = variableSlot(*expr.left);
+        long right = variableSlot(*expr.right);
+        auto literal = dynamic_cast<LiteralExpr*>(expr.right.get());
+
+        if (left >= 0 && right >= 0) {
+            size_t a = static_cast<size_t>(left);
+            size_t b = static_cast<size_t>(right);
+            return store([a, b, line](ClosureState& state) { return Op::apply(state.slots[a], state.slots[b], line); },
+                         target);
+        }
+        if (left >= 0 && literal) {
+            size_t a = static_cast<size_t>(left);
+            double constant = literal->value;
+            return store([a, constant, line](ClosureState& state) { return Op::apply(state.slots[a], constant, line); },
+                         target);
+        }
+
+        ExprClosure leftClosure = compile(*expr.left);
+        if (literal) {
+            double constant = literal->value;
+            return store([leftClosure, constant, line](ClosureState& state) {
+                return Op::apply(leftClosure(state), constant, line);
+            }, target);
+        }
+        if (right >= 0) {
+            size_t b = static_cast<size_t>(right);
+            return store([leftClosure, b, line](ClosureState& state) {
+                double value = leftClosure(state);
+                return Op::apply(value, state.slots[b], line);
+            }, target);
+        }
+        ExprClosure rightClosure = compile(*expr.right);
+        return store([leftClosure, rightClosure, line](ClosureState& state) {
+            double value = leftClosure(state);
+            return Op::apply(value, rightClosure(state), line);
+        }, target);
+    }
+
+    ExprClosure binary(BinaryExpr& expr, long target) {
+        switch (expr.op.type) {
+            case TokenType::PLUS: return binary<Add>(expr, target);
+            case TokenType::MINUS: return binary<Subtract>(expr, target);
+            case TokenType::STAR: return binary<Multiply>(expr, target);
+            case TokenType::SLASH: return binary<Divide>(expr, target);
+            case TokenType::GREATER: return binary<Greater>(expr, target);
+            case TokenType::GREATER_EQUAL: return binary<GreaterEqual>(expr, target);
+            case TokenType::LESS: return binary<Less>(expr, target);
+            case TokenType::LESS_EQUAL: return binary<LessEqual>(expr, target);
+            case TokenType::EQUAL_EQUAL: return binary<Equal>(expr, target);
+            case TokenType::BANG_EQUAL: return binary<NotEqual>(expr, target);
+            default:
+                throw std::runtime_error("Unknown binary operator at line " + std::to_string(expr.op.line));
+        }
+    }
+
+    // ExprVisitor implementations
+    void visitLiteralExpr(LiteralExpr& expr) override {
+        double value = expr.value;
+        expression = [value](ClosureState&) { return value; };
+    }
+
+    void visitVariableExpr(VariableExpr& expr) override {
+        size_t index = slot(expr.depth, expr.slot, expr.name);
+        expression = [index](ClosureState& state) { return state.slots[index]; };
+    }
+
+    void visitUnaryExpr(UnaryExpr& expr) override {
+        long operand = variableSlot(*expr.right);
+        switch (expr.op.type) {
+            case TokenType::MINUS:
+                if (operand >= 0) {
+                    size_t index = static_cast<size_t>(operand);
+                    expression = [index](ClosureState& state) { return -state.slots[index]; };
+                } else {
+                    ExprClosure right = compile(*expr.right);
+                    expression = [right](ClosureState& state) { return -right(state); };
+                }
+                break;
+            case TokenType::BANG: {
+                ExprClosure right = compile(*expr.right);
+                expression = [right](ClosureState& state) { return right(state) != 0.0 ? 0.0 : 1.0; };
+                break;
+            }
+            default:
+                throw std::runtime_error("Unknown unary operator at line " + std::to_string(expr.op.line));
+        }
+    }
+
+    void visitBinaryExpr(BinaryExpr& expr) override {
+        expression = binary(expr, -1);
+    }
+
+    void visitAssignmentExpr(AssignmentExpr& expr) override {
+        size_t index = slot(expr.depth, expr.slot, expr.name);
+        if (auto value = dynamic_cast<BinaryExpr*>(expr.value.get())) {
+            expression = binary(*value, static_cast<long>(index));
+            return;
+        }
+        ExprClosure value = compile(*expr.value);
+        expression = [index, value](ClosureState& state) { return state.slots[index] = value(state); };
+    }
+
+    // StmtVisitor implementations
+    void visitExpressionStmt(ExpressionStmt& stmt) override {
+        ExprClosure value = compile(*stmt.expression);
+        statement = [value](ClosureState& state) { value(state); };
+    }
+
+    void visitVariableDeclarationStmt(VariableDeclarationStmt& stmt) override {
+        size_t index = slot(0, stmt.slot, stmt.name);
+        if (!stmt.initializer) {
+            statement = [index](ClosureState& state) { state.slots[index] = 0.0; };
+            return;
+        }
+        ExprClosure value = compile(*stmt.initializer);
+        statement = [index, value](ClosureState& state) { state.slots[index] = value(state); };
+    }
+
+    void visitBlockStmt(BlockStmt& stmt) override {
+        const Scope& enclosing = scopes.back();
+        Scope scope{enclosing.base + enclosing.size, static_cast<size_t>(std::max(stmt.slotCount, 0))};
+        scopes.push_back(scope);
+        program.slotCount = std::max(program.slotCount, scope.base + scope.size);
+
+        std::vector<StmtClosure> body;
+        body.reserve(stmt.statements.size());
+        for (const auto& inner : stmt.statements) {
+            body.push_back(compile(*inner));
+        }
+        scopes.pop_back();
+        statement = [body = std::move(body)](ClosureState& state) {
+            for (const StmtClosure& inner : body) inner(state);
+        };
+    }
+
+    void visitIfStmt(IfStmt& stmt) override {
+        ExprClosure condition = compile(*stmt.condition);
+        StmtClosure thenBranch = compile(*stmt.thenBranch);
+        if (!stmt.elseBranch) {
+            statement = [condition, thenBranch](ClosureState& state) {
+                if (condition(state) != 0.0) thenBranch(state);
+            };
+            return;
+        }
+        StmtClosure elseBranch = compile(*stmt.elseBranch);
+        statement = [condition, thenBranch, elseBranch](ClosureState& state) {
+            if (condition(state) != 0.0) {
+                thenBranch(state);
+            } else {
+                elseBranch(state);
+            }
+        };
+    }
+
+    void visitWhileStmt(WhileStmt& stmt) override {
+        ExprClosure condition = compile(*stmt.condition);
+        StmtClosure body = compile(*stmt.body);
+        statement = [condition, body](ClosureState& state) {
+            while (condition(state) != 0.0) body(state);
+        };
+    }
+
+    void visitPrintStmt(PrintStmt& stmt) override {
+        ExprClosure value = compile(*stmt.expression);
+        statement = [value](ClosureState& state) { state.output.printNumber(value(state)); };
+    }
+};
+
+class ClosureEvaluator {
+public:
+    ClosureEvaluator(std::ostream& out = std::cout, FlushPolicy policy = FlushPolicy::THRESHOLD,
+                     std::ostream& err = std::cerr)
+        : output(out, policy), errors(&err) {}
+
+    void interpret(const ClosureProgram& program) {
+        slots.assign(program.slotCount, 0.0);
+        ClosureState state{slots.data(), output};
+        try {
+            for (const StmtClosure& statement : program.statements) {
+                statement(state);
+            }
+        } catch (const std::runtime_error& error) {
+            output.flush();
+            *errors << "Runtime error: " << error.what() << "\n";
+        }
+        output.flush();
+    }
+
+private:
+    OutputBuffer output;
+    std::ostream* errors;
+    std::vector<double> slots;
+};
+#endif
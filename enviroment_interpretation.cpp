@@ -1,4 +1,6 @@
-#include "parsing.cpp"
+#include "loop_analysis.cpp"
+#include "profiler.cpp"
+#include "output_buffer.cpp"
 
 // 4. Runtime Environment
 // The environment manages variable scopes and their values.
@@ -10,13 +12,41 @@ public:
     Environment() : enclosing(nullptr) {}
     Environment(Environment* enclosing) : enclosing(enclosing) {}
 
-    void define(const std::string& name, double value) {
-        values[name] = value;
+    void define(uint32_t symbol, double value) {
+        values[symbol] = value;
     }
 
-    void assign(const Token& name, double value) {
+    // Makes a recycled environment look freshly constructed while keeping its storage.
+    void reset(Environment* newEnclosing, int slotCount) {
+        enclosing = newEnclosing;
+        if (!values.empty()) values.clear();
+        slots.assign(slotCount > 0 ? slotCount : 0, 0.0);
+    }
+
+    // Slot-based access for programs annotated by the Resolver.
+    void defineAt(int slot, double value) {
+        if (static_cast<size_t>(slot) >= slots.size()) {
+            slots.resize(slot + 1, 0.0);
+        }
+        slots[slot] = value;
+    }
+
+    // Makes room for slots [0, count) without touching the ones already defined.
+    void reserveSlots(size_t count) {
+        if (count > slots.size()) slots.resize(count, 0.0);
+    }
+
+    double getAt(int depth, int slot) {
+        return ancestor(depth)->slots[slot];
+    }
+
+    void assignAt(int depth, int slot, double value) {
+        ancestor(depth)->slots[slot] = value;
+    }
+
+    void assign(const SymbolToken& name, double value) {
         // TODO: Step 1 - Check if the variable exists in the current scope
-        if (values.find(name.lexeme) != values.end()) {
+        if (values.find(name.symbol) != values.end()) {
             // TODO: Step 2 - If found, assign the new value 
             //complete code here
         }
@@ -28,14 +58,14 @@ public:
         }
     
         // TODO: Step 4 - If the variable is not found in any scope, throw an error
-        throw std::runtime_error("Undefined variable '" + name.lexeme +
+        throw std::runtime_error("Undefined variable '" + std::string(name.lexeme) +
                                  "' at line " + std::to_string(name.line));
     }
 
-    double get(const Token& name) {
+    double get(const SymbolToken& name) {
         // TODO: Step 1 - Look in the current environment
-        if (values.find(name.lexeme) != /*complere code here*/) {
-            return values[name.lexeme];
+        if (values.find(name.symbol) != /*complere code here*/) {
+            return values[name.symbol];
         }
     
         // TODO: Step 2 - If not found, and there is an enclosing environment, search there
@@ -44,14 +74,55 @@ public:
         }
     
         // TODO: Step 3 - If not found in any scope, throw an error
-        throw std::runtime_error("Undefined variable '" + name.lexeme +
+        throw std::runtime_error("Undefined variable '" + std::string(name.lexeme) +
                                  "' at line " + std::to_string(name.line));
     }
     
 
 private:
-    std::unordered_map<std::string, double> values;
+    std::unordered_map<uint32_t, double> values;  // by symbol id, for unresolved programs
+    std::vector<double> slots;
     Environment* enclosing;
+
+    Environment* ancestor(int depth) {
+        Environment* environment = this;
+        for (int i = 0; i < depth; ++i) {
+            environment = environment->enclosing;
+        }
+        return environment;
+    }
+};
+
+// Block environments are recycled instead of built on every entry. Blocks nest strictly,
+// so the environment used at nesting depth d is free again as soon as that block exits.
+class ScopePool {
+public:
+    Environment& acquire(Environment* enclosing, int slotCount) {
+        if (depth == scopes.size()) {
+            scopes.push_back(std::make_unique<Environment>());
+        }
+        Environment& scope = *scopes[depth++];
+        scope.reset(enclosing, slotCount);
+        return scope;
+    }
+
+    void release() {
+        depth--;
+    }
+
+private:
+    std::vector<std::unique_ptr<Environment>> scopes;
+    size_t depth = 0;
+};
+
+// A faster way to run a hot loop, plugged into the Interpreter. Once a loop has run the
+// Interpreter's threshold of iterations, the next time it reaches its condition the loop is
+// offered to run(), which finishes it (reading and writing variables through environment, the
+// loop's scope) and returns true, or returns false to decline it for good.
+class LoopTier {
+public:
+    virtual ~LoopTier() = default;
+    virtual bool run(WhileStmt& loop, size_t iterations, Environment& environment, OutputBuffer& output) = 0;
 };
 
 // 5. Interpretation (Interpreter)
@@ -59,23 +130,63 @@ private:
 
 class Interpreter : public ExprVisitor, public StmtVisitor {
 public:
-    Interpreter() : environment(&global) {}
+    Interpreter(std::ostream& out = std::cout, FlushPolicy policy = FlushPolicy::THRESHOLD,
+                std::ostream& err = std::cerr)
+        : environment(&global), output(out, policy), errors(&err) {}
 
-    void interpret(const std::vector<std::unique_ptr<Stmt>>& statements) {
+    // Returns how many of the statements ran to completion: all of them unless a runtime error
+    // stopped the program.
+    size_t interpret(const std::vector<std::unique_ptr<Stmt>>& statements) {
+        size_t completed = 0;
         try {
             for (const auto& stmt : statements) {
                 execute(*stmt);
+                completed++;
             }
         } catch (const std::runtime_error& error) {
-            std::cerr << "Runtime error: " << error.what() << "\n";
+            output.flush();
+            *errors << "Runtime error: " << error.what() << "\n";
         }
+        output.flush();
+        return completed;
+    }
+
+    // Hands loops that have run threshold iterations (counted over every execution of the loop)
+    // to tier. Passing nullptr goes back to running every loop here.
+    void setLoopTier(LoopTier* tier, size_t threshold) {
+        loopTier = tier;
+        tierThreshold = threshold;
     }
 
+    // Sizes the global frame for a program resolved against it, so a global whose `let` never ran
+    // (the statement before it failed) reads as 0 instead of past the end of the frame.
+    void reserveGlobals(size_t count) {
+        global.reserveSlots(count);
+    }
+
+#ifdef PROFILE_INTERPRETER
+    const Profiler& getProfiler() const { return profiler; }
+#endif
+
 private:
     Environment global;
     Environment* environment;
+    ScopePool scopes;
+    OutputBuffer output;
+    std::ostream* errors;
+    struct LoopCounter {
+        size_t iterations = 0;
+        bool declined = false;  // the tier would not take this loop
+    };
+    LoopTier* loopTier = nullptr;
+    size_t tierThreshold = 0;
+    std::unordered_map<WhileStmt*, LoopCounter> loopCounters;
+#ifdef PROFILE_INTERPRETER
+    Profiler profiler;
+#endif
 
     void execute(Stmt& stmt) {
+        PROFILE_SCOPE(profiler, stmt, false);
         stmt.accept(*this);
     }
 
@@ -109,7 +220,8 @@ private:
 
     void visitVariableExpr(VariableExpr& expr) override {
         // TODO: Step 1 - Push the literal's name value onto the value stack
-        double value = environment->get(expr.name);
+        double value = expr.slot >= 0 ? environment->getAt(expr.depth, expr.slot)
+                                      : environment->get(expr.name);
         /*Complete the code here */
     }
 
@@ -210,17 +322,29 @@ private:
         double value = evaluate(*expr.value);
     
         // TODO: Step 2 - Assign the value to the variable in the current or enclosing environment
-        environment->assign(expr.name, value);
+        if (expr.slot >= 0) {
+            environment->assignAt(expr.depth, expr.slot, value);
+        } else {
+            environment->assign(expr.name, value);
+        }
     
         // TODO: Step 3 - Push the assigned value to the value stack (to support nested expressions)
         valueStack.push_back(value);
     }
     
 
+    void visitVariableDeclarationStmt(VariableDeclarationStmt& stmt) override {
+        double value = stmt.initializer ? evaluate(*stmt.initializer) : 0.0;
+        if (stmt.slot >= 0) {
+            environment->defineAt(stmt.slot, value);
+        } else {
+            environment->define(stmt.name.symbol, value);
+        }
+    }
+
     void visitBlockStmt(BlockStmt& stmt) override {
-        // TODO: Step 1 - Create a new environment that encloses the current one
-        ///*complete the code here: create a newEnv object, pass environment as argument*/
-        
+        // Step 1 - Take a recycled environment that encloses the current one
+        Environment& newEnv = scopes.acquire(environment, stmt.slotCount);
     
         // TODO: Step 2 - Save the current environment so we can restore it later
         Environment* previous = environment;
@@ -236,11 +360,13 @@ private:
         } catch (...) {
             // On exception, restore environment before re-throwing
             environment = previous;
+            scopes.release();
             throw;
         }
     
         // TODO: Step 5 - Restore the outer environment
         environment = previous;
+        scopes.release();
     }
     
 
@@ -254,14 +380,35 @@ private:
     }
 
     void visitWhileStmt(WhileStmt& stmt) override {
+        if (loopTier) {
+            executeTiered(stmt);
+            return;
+        }
         while (isTruthy(evaluate(*stmt.condition))) {
+            PROFILE_SCOPE(profiler, stmt, true);
+            execute(*stmt.body);
+        }
+    }
+
+    // The same loop, counting iterations and handing it to the tier, between two iterations,
+    // once it is hot.
+    void executeTiered(WhileStmt& stmt) {
+        LoopCounter& counter = loopCounters[&stmt];  // unordered_map references survive rehashing
+        for (;;) {
+            if (counter.iterations >= tierThreshold && !counter.declined) {
+                if (loopTier->run(stmt, counter.iterations, *environment, output)) return;
+                counter.declined = true;
+            }
+            if (!isTruthy(evaluate(*stmt.condition))) return;
+            PROFILE_SCOPE(profiler, stmt, true);
             execute(*stmt.body);
+            counter.iterations++;
         }
     }
 
     void visitPrintStmt(PrintStmt& stmt) override {
         double value = evaluate(*stmt.expression);
-        std::cout << value << "\n";
+        output.printNumber(value);
     }
 
     // Helper functions
@@ -0,0 +1,298 @@
+#include "enviroment_interpretation.cpp"
+#include <cstdint>
+
+// 8. Flat AST (FlatProgram, FlatEvaluator)
+// An alternative, compact representation of a resolved program. Nodes are small POD records
+// in one vector, tagged by kind, with children referenced by 32-bit indices. The evaluator
+// walks them with a switch instead of virtual accept() calls.
+
+#ifndef FLAT_AST
+#define FLAT_AST
+
+enum class FlatKind : uint8_t {
+    LITERAL,          // a = constant index
+    VARIABLE,         // depth, a = slot
+    UNARY,            // op, a = operand
+    BINARY,           // op, a = left, b = right
+    ASSIGNMENT,       // depth, a = slot, b = value
+    EXPRESSION_STMT,  // a = expression
+    VARIABLE_DECL,    // a = slot, b = initializer or kNone
+    BLOCK,            // a = first entry in lists, b = statement count, c = slot count
+    IF,               // a = condition, b = then branch, c = else branch or kNone
+    WHILE,            // a = condition, b = body
+    PRINT             // a = expression
+};
+
+struct FlatNode {
+    FlatKind kind;
+    uint8_t op;       // TokenType of UNARY/BINARY operators
+    uint16_t depth;
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+    int32_t line;
+};
+
+struct FlatProgram {
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    std::vector<FlatNode> nodes;
+    std::vector<double> constants;
+    std::vector<uint32_t> lists;  // statement indices of blocks and of the top level
+    uint32_t first = 0;           // top-level statements are lists[first, first + count)
+    uint32_t count = 0;
+    uint32_t globalSlots = 0;
+
+    size_t memoryBytes() const {
+        return nodes.size() * sizeof(FlatNode) + constants.size() * sizeof(double) +
+               lists.size() * sizeof(uint32_t);
+    }
+};
+
+// Converts a resolved pointer tree into a FlatProgram.
+class FlatAstBuilder : public ExprVisitor, public StmtVisitor {
+public:
+    FlatProgram build(const std::vector<std::unique_ptr<Stmt>>& statements, size_t globalSlots) {
+        program = FlatProgram();
+        program.globalSlots = static_cast<uint32_t>(globalSlots);
+        program.first = addList(statements, program.count);
+        return std::move(program);
+    }
+
+private:
+    FlatProgram program;
+    uint32_t result = 0;
+
+    uint32_t add(FlatKind kind, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, int line = 0) {
+        program.nodes.push_back({kind, 0, 0, a, b, c, line});
+        return static_cast<uint32_t>(program.nodes.size() - 1);
+    }
+
+    uint32_t build(Expr& expr) {
+        expr.accept(*this);
+        return result;
+    }
+
+    uint32_t build(Stmt& stmt) {
+        stmt.accept(*this);
+        return result;
+    }
+
+    uint32_t addList(const std::vector<std::unique_ptr<Stmt>>& statements, uint32_t& count) {
+        std::vector<uint32_t> indices;
+        indices.reserve(statements.size());
+        for (const auto& stmt : statements) {
+            indices.push_back(build(*stmt));
+        }
+        uint32_t first = static_cast<uint32_t>(program.lists.size());
+        program.lists.insert(program.lists.end(), indices.begin(), indices.end());
+        count = static_cast<uint32_t>(indices.size());
+        return first;
+    }
+
+    static void requireResolved(int slot, const SymbolToken& name) {
+        if (slot < 0) {
+            throw std::runtime_error("Variable '" + std::string(name.lexeme) + "' at line " + std::to_string(name.line) +
+                                     " was not resolved before flattening");
+        }
+    }
+
+    // ExprVisitor implementations
+    void visitLiteralExpr(LiteralExpr& expr) override {
+        program.constants.push_back(expr.value);
+        result = add(FlatKind::LITERAL, static_cast<uint32_t>(program.constants.size() - 1));
+    }
+
+    void visitVariableExpr(VariableExpr& expr) override {
+        requireResolved(expr.slot, expr.name);
+        result = add(FlatKind::VARIABLE, expr.slot, 0, 0, expr.name.line);
+        program.nodes[result].depth = static_cast<uint16_t>(expr.depth);
+    }
+
+    void visitUnaryExpr(UnaryExpr& expr) override {
+        uint32_t operand = build(*expr.right);
+        result = add(FlatKind::UNARY, operand, 0, 0, expr.op.line);
+        program.nodes[result].op = static_cast<uint8_t>(expr.op.type);
+    }
+
+    void visitBinaryExpr(BinaryExpr& expr) override {
+        uint32_t left = build(*expr.left);
+        uint32_t right = build(*expr.right);
+        result = add(FlatKind::BINARY, left, right, 0, expr.op.line);
+        program.nodes[result].op = static_cast<uint8_t>(expr.op.type);
+    }
+
+    void visitAssignmentExpr(AssignmentExpr& expr) override {
+        requireResolved(expr.slot, expr.name);
+        uint32_t value = build(*expr.value);
+        result = add(FlatKind::ASSIGNMENT, expr.slot, value, 0, expr.name.line);
+        program.nodes[result].depth = static_cast<uint16_t>(expr.depth);
+    }
+
+    // StmtVisitor implementations
+    void visitExpressionStmt(ExpressionStmt& stmt) override {
+        uint32_t expression = build(*stmt.expression);
+        result = add(FlatKind::EXPRESSION_STMT, expression);
+    }
+
+    void visitVariableDeclarationStmt(VariableDeclarationStmt& stmt) override {
+        requireResolved(stmt.slot, stmt.name);
+        uint32_t initializer = stmt.initializer ? build(*stmt.initializer) : FlatProgram::kNone;
+        result = add(FlatKind::VARIABLE_DECL, stmt.slot, initializer, 0, stmt.name.line);
+    }
+
+    void visitBlockStmt(BlockStmt& stmt) override {
+        uint32_t count = 0;
+        uint32_t first = addList(stmt.statements, count);
+        result = add(FlatKind::BLOCK, first, count, static_cast<uint32_t>(std::max(stmt.slotCount, 0)));
+    }
+
+    void visitIfStmt(IfStmt& stmt) override {
+        uint32_t condition = build(*stmt.condition);
+        uint32_t thenBranch = build(*stmt.thenBranch);
+        uint32_t elseBranch = stmt.elseBranch ? build(*stmt.elseBranch) : FlatProgram::kNone;
+        result = add(FlatKind::IF, condition, thenBranch, elseBranch);
+    }
+
+    void visitWhileStmt(WhileStmt& stmt) override {
+        uint32_t condition = build(*stmt.condition);
+        uint32_t body = build(*stmt.body);
+        result = add(FlatKind::WHILE, condition, body);
+    }
+
+    void visitPrintStmt(PrintStmt& stmt) override {
+        uint32_t expression = build(*stmt.expression);
+        result = add(FlatKind::PRINT, expression);
+    }
+};
+
+class FlatEvaluator {
+public:
+    FlatEvaluator(std::ostream& out = std::cout, FlushPolicy policy = FlushPolicy::THRESHOLD,
+                  std::ostream& err = std::cerr)
+        : output(out, policy), errors(&err) {}
+
+    void interpret(const FlatProgram& program) {
+        try {
+            this->program = &program;
+            values.assign(program.globalSlots, 0.0);
+            frames.assign(1, 0);
+            for (uint32_t i = 0; i < program.count; ++i) {
+                execute(program.lists[program.first + i]);
+            }
+        } catch (const std::runtime_error& error) {
+            output.flush();
+            *errors << "Runtime error: " << error.what() << "\n";
+        }
+        output.flush();
+    }
+
+private:
+    OutputBuffer output;
+    std::ostream* errors;
+    const FlatProgram* program = nullptr;
+    std::vector<double> values;   // every live frame, innermost last
+    std::vector<size_t> frames;   // start of each frame in values
+
+    double& slot(uint16_t depth, uint32_t index) {
+        return values[frames[frames.size() - 1 - depth] + index];
+    }
+
+    void execute(uint32_t index) {
+        const FlatNode& node = program->nodes[index];
+        switch (node.kind) {
+            case FlatKind::EXPRESSION_STMT:
+                evaluate(node.a);
+                break;
+            case FlatKind::VARIABLE_DECL:
+                slot(0, node.a) = node.b == FlatProgram::kNone ? 0.0 : evaluate(node.b);
+                break;
+            case FlatKind::BLOCK: {
+                frames.push_back(values.size());
+                values.resize(values.size() + node.c, 0.0);
+                try {
+                    for (uint32_t i = 0; i < node.b; ++i) {
+                        execute(program->lists[node.a + i]);
+                    }
+                } catch (...) {
+                    values.resize(frames.back());
+                    frames.pop_back();
+                    throw;
+                }
+                values.resize(frames.back());
+                frames.pop_back();
+                break;
+            }
+            case FlatKind::IF:
+                if (isTruthy(evaluate(node.a))) {
+                    execute(node.b);
+                } else if (node.c != FlatProgram::kNone) {
+                    execute(node.c);
+                }
+                break;
+            case FlatKind::WHILE:
+                while (isTruthy(evaluate(node.a))) {
+                    execute(node.b);
+                }
+                break;
+            case FlatKind::PRINT:
+                output.printNumber(evaluate(node.a));
+                break;
+            default:
+                throw std::runtime_error("Expected a statement in flat program");
+        }
+    }
+
+    double evaluate(uint32_t index) {
+        const FlatNode& node = program->nodes[index];
+        switch (node.kind) {
+            case FlatKind::LITERAL:
+                return program->constants[node.a];
+            case FlatKind::VARIABLE:
+                return slot(node.depth, node.a);
+            case FlatKind::ASSIGNMENT: {
+                double value = evaluate(node.b);
+                slot(node.depth, node.a) = value;
+                return value;
+            }
+            case FlatKind::UNARY: {
+                double right = evaluate(node.a);
+                switch (static_cast<TokenType>(node.op)) {
+                    case TokenType::MINUS: return -right;
+                    case TokenType::BANG: return isTruthy(right) ? 0.0 : 1.0;
+                    default:
+                        throw std::runtime_error("Unknown unary operator at line " + std::to_string(node.line));
+                }
+            }
+            case FlatKind::BINARY: {
+                double left = evaluate(node.a);
+                double right = evaluate(node.b);
+                switch (static_cast<TokenType>(node.op)) {
+                    case TokenType::PLUS: return left + right;
+                    case TokenType::MINUS: return left - right;
+                    case TokenType::STAR: return left * right;
+                    case TokenType::SLASH:
+                        if (right == 0) {
+                            throw std::runtime_error("Division by zero at line " + std::to_string(node.line));
+                        }
+                        return left / right;
+                    case TokenType::GREATER: return left > right ? 1.0 : 0.0;
+                    case TokenType::GREATER_EQUAL: return left >= right ? 1.0 : 0.0;
+                    case TokenType::LESS: return left < right ? 1.0 : 0.0;
+                    case TokenType::LESS_EQUAL: return left <= right ? 1.0 : 0.0;
+                    case TokenType::EQUAL_EQUAL: return left == right ? 1.0 : 0.0;
+                    case TokenType::BANG_EQUAL: return left != right ? 1.0 : 0.0;
+                    default:
+                        throw std::runtime_error("Unknown binary operator at line " + std::to_string(node.line));
+                }
+            }
+            default:
+                throw std::runtime_error("Expected an expression in flat program");
+        }
+    }
+
+    static bool isTruthy(double value) {
+        return value != 0.0;
+    }
+};
+#endif
@@ -0,0 +1,39 @@
+#include "resumable_interpreter.cpp"
+#include <limits>
+
+// 19. Non-recursive Evaluation (IterativeInterpreter)
+// Runs a resolved program to completion on the WorkStackEvaluator, without a native call per
+// nesting level: the work and value stacks are heap vectors with room reserved up front, so a
+// program nested tens of thousands of levels deep runs like a shallow one. Output goes through an
+// OutputBuffer and errors to a stream of the caller's choosing, as in the Interpreter.
+
+#ifndef ITERATIVE_INTERPRETER
+#define ITERATIVE_INTERPRETER
+
+class IterativeInterpreter {
+public:
+    IterativeInterpreter(std::ostream& out = std::cout, FlushPolicy policy = FlushPolicy::THRESHOLD,
+                         std::ostream& err = std::cerr)
+        : output(out, policy), errors(&err) {}
+
+    void interpret(const std::vector<std::unique_ptr<Stmt>>& statements, size_t globalSlots) {
+        WorkStackEvaluator evaluator(statements, globalSlots, output);
+        try {
+            evaluator.run(std::numeric_limits<size_t>::max());
+        } catch (const std::runtime_error& error) {
+            output.flush();
+            *errors << "Runtime error: " << error.what() << "\n";
+        }
+        deepest = evaluator.maxDepth();
+        output.flush();
+    }
+
+    // The deepest nesting of statements and expressions the last program reached while running.
+    size_t maxDepth() const { return deepest; }
+
+private:
+    OutputBuffer output;
+    std::ostream* errors;
+    size_t deepest = 0;
+};
+#endif
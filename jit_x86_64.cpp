@@ -0,0 +1,375 @@
+#include "enviroment_interpretation.cpp"
+#include <cstdint>
+#include <cstring>
+
+// 9. Native Code Generation (JitCompiler, JitEngine)
+// A template JIT for Linux x86-64. Every resolved statement and expression is translated
+// straight into machine code: variables live in one frame of stack slots addressed through
+// rbx, arithmetic uses SSE2 scalar double instructions with xmm0 as the accumulator, and
+// `print` calls back into the runtime. Division by zero is checked inline and reported with
+// the same message and line as the Interpreter. Anything the JIT cannot compile, or any other
+// platform, falls back to the Interpreter.
+
+#ifndef JIT_X86_64
+#define JIT_X86_64
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_AVAILABLE 1
+#include <sys/mman.h>
+#endif
+
+// Raised while compiling when a construct cannot be translated.
+class JitUnsupported : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+#ifdef JIT_AVAILABLE
+
+// Executable memory holding one compiled program.
+class ExecutableMemory {
+public:
+    explicit ExecutableMemory(const std::vector<uint8_t>& code) : size(code.size()) {
+        void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            throw JitUnsupported("Could not map memory for native code");
+        }
+        std::memcpy(memory, code.data(), size);
+        if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+            munmap(memory, size);
+            throw JitUnsupported("Could not make native code executable");
+        }
+        base = memory;
+    }
+
+    ~ExecutableMemory() {
+        munmap(base, size);
+    }
+
+    ExecutableMemory(const ExecutableMemory&) = delete;
+    ExecutableMemory& operator=(const ExecutableMemory&) = delete;
+
+    // Compiled programs take the frame of slots and return 0, or the line of a division by zero.
+    using Entry = int (*)(double* frame);
+
+    Entry entry() const { return reinterpret_cast<Entry>(base); }
+
+private:
+    void* base = nullptr;
+    size_t size;
+};
+
+// Called from native code for every `print`.
+static void jitPrint(OutputBuffer* output, double value) noexcept {
+    try {
+        output->printNumber(value);
+    } catch (...) {
+        // Native frames have no unwind information, so nothing may propagate through them.
+    }
+}
+
+class JitCompiler : public ExprVisitor, public StmtVisitor {
+public:
+    explicit JitCompiler(OutputBuffer& output) : output(output) {}
+
+    // Translates a resolved program. Throws JitUnsupported if some part cannot be compiled.
+    std::vector<uint8_t> compile(const std::vector<std::unique_ptr<Stmt>>& statements, size_t globalSlots) {
+        code.clear();
+        exitJumps.clear();
+        scopeBases.assign(1, 0);
+        top = globalSlots;
+        frameSize = globalSlots;
+
+        // push rbp; mov rbp, rsp; push rbx; sub rsp, 8 (keeps rsp 16-byte aligned for calls)
+        emit({0x55, 0x48, 0x89, 0xE5, 0x53, 0x48, 0x83, 0xEC, 0x08});
+        // mov rbx, rdi: the frame of slots
+        emit({0x48, 0x89, 0xFB});
+
+        for (const auto& stmt : statements) {
+            stmt->accept(*this);
+        }
+
+        // xor eax, eax
+        emit({0x31, 0xC0});
+        size_t exit = code.size();
+        for (size_t jump : exitJumps) {
+            patch(jump, exit);
+        }
+        // lea rsp, [rbp - 8]; pop rbx; pop rbp; ret
+        emit({0x48, 0x8D, 0x65, 0xF8, 0x5B, 0x5D, 0xC3});
+        return code;
+    }
+
+    size_t frameSlots() const { return frameSize; }
+
+private:
+    OutputBuffer& output;
+    std::vector<uint8_t> code;
+    std::vector<size_t> exitJumps;
+    std::vector<size_t> scopeBases;  // first absolute slot of every enclosing scope
+    size_t top = 0;
+    size_t frameSize = 0;
+
+    // Emission helpers
+    void emit(std::initializer_list<uint8_t> bytes) {
+        code.insert(code.end(), bytes.begin(), bytes.end());
+    }
+
+    void emit32(uint32_t value) {
+        uint8_t bytes[4];
+        std::memcpy(bytes, &value, sizeof(value));
+        code.insert(code.end(), bytes, bytes + 4);
+    }
+
+    void emit64(uint64_t value) {
+        uint8_t bytes[8];
+        std::memcpy(bytes, &value, sizeof(value));
+        code.insert(code.end(), bytes, bytes + 8);
+    }
+
+    // Emits the opcode bytes of a rel32 jump and returns where its offset goes.
+    size_t emitJump(std::initializer_list<uint8_t> opcode) {
+        emit(opcode);
+        size_t offset = code.size();
+        emit32(0);
+        return offset;
+    }
+
+    void patch(size_t offset, size_t target) {
+        int32_t relative = static_cast<int32_t>(target - (offset + 4));
+        std::memcpy(&code[offset], &relative, sizeof(relative));
+    }
+
+    // mov rax, imm64; movq xmmN, rax
+    void loadConstant(double value, int xmm) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        emit({0x48, 0xB8});
+        emit64(bits);
+        emit({0x66, 0x48, 0x0F, 0x6E, static_cast<uint8_t>(0xC0 | (xmm << 3))});
+    }
+
+    // movsd xmmN, [rbx + slot * 8]
+    void loadSlot(size_t slot, int xmm) {
+        emit({0xF2, 0x0F, 0x10, static_cast<uint8_t>(0x83 | (xmm << 3))});
+        emit32(static_cast<uint32_t>(slot * sizeof(double)));
+    }
+
+    // movsd [rbx + slot * 8], xmm0
+    void storeSlot(size_t slot) {
+        emit({0xF2, 0x0F, 0x11, 0x83});
+        emit32(static_cast<uint32_t>(slot * sizeof(double)));
+    }
+
+    size_t absoluteSlot(int depth, int slot, const SymbolToken& name) {
+        if (slot < 0 || depth < 0 || static_cast<size_t>(depth) >= scopeBases.size()) {
+            throw JitUnsupported("Variable '" + std::string(name.lexeme) + "' at line " + std::to_string(name.line) +
+                                 " is not resolved");
+        }
+        return scopeBases[scopeBases.size() - 1 - depth] + slot;
+    }
+
+    // Jumps to the returned offset when xmm0 is falsy (== 0.0; NaN counts as truthy).
+    size_t emitJumpIfFalse() {
+        // xorpd xmm1, xmm1; ucomisd xmm0, xmm1; jp +6; je rel32
+        emit({0x66, 0x0F, 0x57, 0xC9, 0x66, 0x0F, 0x2E, 0xC1, 0x7A, 0x06});
+        return emitJump({0x0F, 0x84});
+    }
+
+    // Turns an all-ones/all-zeros compare mask in xmm0 into 1.0/0.0.
+    void maskToBoolean() {
+        loadConstant(1.0, 2);
+        emit({0x66, 0x0F, 0x54, 0xC2});  // andpd xmm0, xmm2
+    }
+
+    // Loads the right operand of a binary expression into xmm1, keeping the left one in xmm0.
+    void loadRightOperand(Expr& right) {
+        if (auto literal = dynamic_cast<LiteralExpr*>(&right)) {
+            loadConstant(literal->value, 1);
+        } else if (auto variable = dynamic_cast<VariableExpr*>(&right)) {
+            loadSlot(absoluteSlot(variable->depth, variable->slot, variable->name), 1);
+        } else {
+            // sub rsp, 8; movsd [rsp], xmm0
+            emit({0x48, 0x83, 0xEC, 0x08, 0xF2, 0x0F, 0x11, 0x04, 0x24});
+            right.accept(*this);
+            // movapd xmm1, xmm0; movsd xmm0, [rsp]; add rsp, 8
+            emit({0x66, 0x0F, 0x28, 0xC8, 0xF2, 0x0F, 0x10, 0x04, 0x24, 0x48, 0x83, 0xC4, 0x08});
+        }
+    }
+
+    // ExprVisitor implementations
+    void visitLiteralExpr(LiteralExpr& expr) override {
+        loadConstant(expr.value, 0);
+    }
+
+    void visitVariableExpr(VariableExpr& expr) override {
+        loadSlot(absoluteSlot(expr.depth, expr.slot, expr.name), 0);
+    }
+
+    void visitUnaryExpr(UnaryExpr& expr) override {
+        expr.right->accept(*this);
+        switch (expr.op.type) {
+            case TokenType::MINUS:
+                loadConstant(-0.0, 1);
+                emit({0x66, 0x0F, 0x57, 0xC1});  // xorpd xmm0, xmm1
+                break;
+            case TokenType::BANG:
+                // xorpd xmm1, xmm1; cmpeqsd xmm0, xmm1
+                emit({0x66, 0x0F, 0x57, 0xC9, 0xF2, 0x0F, 0xC2, 0xC1, 0x00});
+                maskToBoolean();
+                break;
+            default:
+                throw JitUnsupported("Unknown unary operator at line " + std::to_string(expr.op.line));
+        }
+    }
+
+    void visitBinaryExpr(BinaryExpr& expr) override {
+        expr.left->accept(*this);
+        loadRightOperand(*expr.right);
+
+        switch (expr.op.type) {
+            case TokenType::PLUS: emit({0xF2, 0x0F, 0x58, 0xC1}); break;   // addsd xmm0, xmm1
+            case TokenType::MINUS: emit({0xF2, 0x0F, 0x5C, 0xC1}); break;  // subsd xmm0, xmm1
+            case TokenType::STAR: emit({0xF2, 0x0F, 0x59, 0xC1}); break;   // mulsd xmm0, xmm1
+            case TokenType::SLASH: {
+                // xorpd xmm2, xmm2; ucomisd xmm1, xmm2; jp ok; jne ok
+                emit({0x66, 0x0F, 0x57, 0xD2, 0x66, 0x0F, 0x2E, 0xCA, 0x7A, 0x0C, 0x75, 0x0A});
+                emit({0xB8});  // mov eax, line
+                emit32(static_cast<uint32_t>(expr.op.line));
+                exitJumps.push_back(emitJump({0xE9}));
+                emit({0xF2, 0x0F, 0x5E, 0xC1});  // ok: divsd xmm0, xmm1
+                break;
+            }
+            // cmpsd xmm0, xmm1, predicate (0 eq, 1 lt, 2 le, 4 neq); false on NaN except neq
+            case TokenType::EQUAL_EQUAL: emit({0xF2, 0x0F, 0xC2, 0xC1, 0x00}); maskToBoolean(); break;
+            case TokenType::BANG_EQUAL: emit({0xF2, 0x0F, 0xC2, 0xC1, 0x04}); maskToBoolean(); break;
+            case TokenType::LESS: emit({0xF2, 0x0F, 0xC2, 0xC1, 0x01}); maskToBoolean(); break;
+            case TokenType::LESS_EQUAL: emit({0xF2, 0x0F, 0xC2, 0xC1, 0x02}); maskToBoolean(); break;
+            // a > b is b < a: movapd xmm2, xmm1; cmpsd xmm2, xmm0, predicate; movapd xmm0, xmm2
+            case TokenType::GREATER:
+                emit({0x66, 0x0F, 0x28, 0xD1, 0xF2, 0x0F, 0xC2, 0xD0, 0x01, 0x66, 0x0F, 0x28, 0xC2});
+                maskToBoolean();
+                break;
+            case TokenType::GREATER_EQUAL:
+                emit({0x66, 0x0F, 0x28, 0xD1, 0xF2, 0x0F, 0xC2, 0xD0, 0x02, 0x66, 0x0F, 0x28, 0xC2});
+                maskToBoolean();
+                break;
+            default:
+                throw JitUnsupported("Unknown binary operator at line " + std::to_string(expr.op.line));
+        }
+    }
+
+    void visitAssignmentExpr(AssignmentExpr& expr) override {
+        expr.value->accept(*this);
+        storeSlot(absoluteSlot(expr.depth, expr.slot, expr.name));
+    }
+
+    // StmtVisitor implementations
+    void visitExpressionStmt(ExpressionStmt& stmt) override {
+        stmt.expression->accept(*this);
+    }
+
+    void visitVariableDeclarationStmt(VariableDeclarationStmt& stmt) override {
+        if (stmt.initializer) {
+            stmt.initializer->accept(*this);
+        } else {
+            emit({0x66, 0x0F, 0x57, 0xC0});  // xorpd xmm0, xmm0
+        }
+        storeSlot(absoluteSlot(0, stmt.slot, stmt.name));
+    }
+
+    void visitBlockStmt(BlockStmt& stmt) override {
+        if (stmt.slotCount < 0) {
+            throw JitUnsupported("Block at line " + std::to_string(stmt.line) + " is not resolved");
+        }
+        scopeBases.push_back(top);
+        top += stmt.slotCount;
+        frameSize = std::max(frameSize, top);
+        for (const auto& statement : stmt.statements) {
+            statement->accept(*this);
+        }
+        top = scopeBases.back();
+        scopeBases.pop_back();
+    }
+
+    void visitIfStmt(IfStmt& stmt) override {
+        stmt.condition->accept(*this);
+        size_t elseJump = emitJumpIfFalse();
+        stmt.thenBranch->accept(*this);
+        if (stmt.elseBranch) {
+            size_t endJump = emitJump({0xE9});
+            patch(elseJump, code.size());
+            stmt.elseBranch->accept(*this);
+            patch(endJump, code.size());
+        } else {
+            patch(elseJump, code.size());
+        }
+    }
+
+    void visitWhileStmt(WhileStmt& stmt) override {
+        size_t loopStart = code.size();
+        stmt.condition->accept(*this);
+        size_t exitJump = emitJumpIfFalse();
+        stmt.body->accept(*this);
+        patch(emitJump({0xE9}), loopStart);
+        patch(exitJump, code.size());
+    }
+
+    void visitPrintStmt(PrintStmt& stmt) override {
+        stmt.expression->accept(*this);
+        // mov rdi, &output; mov rax, &jitPrint; call rax (value is already in xmm0)
+        emit({0x48, 0xBF});
+        emit64(reinterpret_cast<uint64_t>(&output));
+        emit({0x48, 0xB8});
+        emit64(reinterpret_cast<uint64_t>(&jitPrint));
+        emit({0xFF, 0xD0});
+    }
+};
+
+#endif
+
+class JitEngine {
+public:
+    JitEngine(std::ostream& out = std::cout, FlushPolicy policy = FlushPolicy::THRESHOLD,
+              std::ostream& err = std::cerr)
+        : out(out), errors(err), policy(policy), output(out, policy) {}
+
+    // Runs a resolved program as native code. Falls back to the Interpreter when the program
+    // (or this platform) is not supported; returns whether native code was used.
+    bool run(const std::vector<std::unique_ptr<Stmt>>& statements, size_t globalSlots) {
+#ifdef JIT_AVAILABLE
+        std::vector<uint8_t> code;
+        size_t frameSlots = 0;
+        try {
+            JitCompiler compiler(output);
+            code = compiler.compile(statements, globalSlots);
+            frameSlots = compiler.frameSlots();
+        } catch (const JitUnsupported&) {
+            code.clear();
+        }
+
+        if (!code.empty()) {
+            ExecutableMemory memory(code);
+            std::vector<double> frame(frameSlots + 1, 0.0);
+            int errorLine = memory.entry()(frame.data());
+            output.flush();
+            if (errorLine != 0) {
+                errors << "Runtime error: Division by zero at line " << errorLine << "\n";
+            }
+            return true;
+        }
+#else
+        (void)globalSlots;
+#endif
+        Interpreter interpreter(out, policy, errors);
+        interpreter.interpret(statements);
+        return false;
+    }
+
+private:
+    std::ostream& out;
+    std::ostream& errors;
+    FlushPolicy policy;
+    OutputBuffer output;
+};
+#endif
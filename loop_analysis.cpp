@@ -0,0 +1,462 @@
+#include "resolver.cpp"
+#include <cmath>
+#include <unordered_set>
+
+// 3c. Loop Analysis (LoopAnalyzer)
+// Runs before the Resolver binds slots but after Resolver::check has reported undefined names,
+// so moving an expression out of a loop cannot change the order of those errors. For every
+// WhileStmt it collects the variables the loop writes, recognizes basic induction variables
+// (i = i + c, once per iteration) and, when the start value, step and bound are all constants,
+// stores the trip count on the WhileStmt. With hoisting enabled, loop-invariant subexpressions are computed
+// once into `$invN` temporaries declared in a block wrapped around the loop.
+// Only expressions that cannot fail are hoisted: a division whose divisor is not a nonzero
+// constant stays in the loop, so a division by zero is still reported where and when it happens.
+
+#ifndef LOOP_ANALYSIS
+#define LOOP_ANALYSIS
+
+// A basic induction variable: updated by a constant step exactly once per iteration.
+struct InductionVariable {
+    std::string name;
+    bool knownStart = false;
+    double start = 0;
+    double step = 0;
+};
+
+// Everything the analysis learned about one loop.
+struct LoopInfo {
+    int line = 0;
+    std::vector<std::string> written;           // assigned or declared inside the loop
+    std::vector<InductionVariable> inductions;  // in the order the body updates them
+    long long tripCount = -1;                   // of the one the condition tests; -1 when unknown
+    size_t hoisted = 0;
+};
+
+// Collects the names a loop writes: assignment targets and names declared in its body.
+class LoopWriteCollector : public ExprVisitor, public StmtVisitor {
+public:
+    std::unordered_map<uint32_t, int> assignments;  // by symbol id
+    std::unordered_set<uint32_t> declared;
+
+    void collect(WhileStmt& loop) {
+        loop.condition->accept(*this);
+        loop.body->accept(*this);
+    }
+
+    void collect(Stmt& stmt) {
+        stmt.accept(*this);
+    }
+
+    bool writes(uint32_t symbol) const {
+        return assignments.count(symbol) > 0 || declared.count(symbol) > 0;
+    }
+
+private:
+    // ExprVisitor implementations
+    void visitLiteralExpr(LiteralExpr&) override {}
+    void visitVariableExpr(VariableExpr&) override {}
+    void visitUnaryExpr(UnaryExpr& expr) override { expr.right->accept(*this); }
+    void visitBinaryExpr(BinaryExpr& expr) override {
+        expr.left->accept(*this);
+        expr.right->accept(*this);
+    }
+    void visitAssignmentExpr(AssignmentExpr& expr) override {
+        assignments[expr.name.symbol]++;
+        expr.value->accept(*this);
+    }
+
+    // StmtVisitor implementations
+    void visitExpressionStmt(ExpressionStmt& stmt) override { stmt.expression->accept(*this); }
+    void visitVariableDeclarationStmt(VariableDeclarationStmt& stmt) override {
+        declared.insert(stmt.name.symbol);
+        if (stmt.initializer) stmt.initializer->accept(*this);
+    }
+    void visitBlockStmt(BlockStmt& stmt) override {
+        for (const auto& statement : stmt.statements) statement->accept(*this);
+    }
+    void visitIfStmt(IfStmt& stmt) override {
+        stmt.condition->accept(*this);
+        stmt.thenBranch->accept(*this);
+        if (stmt.elseBranch) stmt.elseBranch->accept(*this);
+    }
+    void visitWhileStmt(WhileStmt& stmt) override {
+        stmt.condition->accept(*this);
+        stmt.body->accept(*this);
+    }
+    void visitPrintStmt(PrintStmt& stmt) override { stmt.expression->accept(*this); }
+};
+
+// Replaces loop-invariant, non-failing subexpressions of one loop by temporaries.
+class InvariantHoister : public ExprVisitor, public StmtVisitor {
+public:
+    InvariantHoister(const LoopWriteCollector& writes, int line, size_t& nextTemporary)
+        : writes(writes), line(line), nextTemporary(nextTemporary) {}
+
+    // Declarations of the temporaries, in evaluation order.
+    std::vector<std::unique_ptr<Stmt>> temporaries;
+
+    void hoist(WhileStmt& loop) {
+        hoistRoot(loop.condition);
+        loop.body->accept(*this);
+    }
+
+private:
+    const LoopWriteCollector& writes;
+    int line;
+    size_t& nextTemporary;
+
+    // Results of the last visited expression.
+    bool invariant = false;
+    bool readsVariable = false;
+
+    bool classify(Expr& expr) {
+        expr.accept(*this);
+        return invariant;
+    }
+
+    // Moves expr into a new temporary unless it is a lone variable (nothing to save).
+    void replace(std::unique_ptr<Expr>& expr) {
+        if (dynamic_cast<VariableExpr*>(expr.get())) return;
+
+        SymbolToken name(TokenType::IDENTIFIER, "$inv" + std::to_string(nextTemporary++), line);
+        auto declaration = std::make_unique<VariableDeclarationStmt>(name, std::move(expr));
+        declaration->line = line;
+        temporaries.push_back(std::move(declaration));
+        expr = std::make_unique<VariableExpr>(name);
+    }
+
+    void hoistRoot(std::unique_ptr<Expr>& expr) {
+        if (classify(*expr) && readsVariable) {
+            replace(expr);
+        }
+    }
+
+    static bool isNonZeroLiteral(const std::unique_ptr<Expr>& expr) {
+        auto literal = dynamic_cast<LiteralExpr*>(expr.get());
+        return literal && literal->value != 0.0;
+    }
+
+    // ExprVisitor implementations
+    void visitLiteralExpr(LiteralExpr&) override {
+        invariant = true;
+        readsVariable = false;
+    }
+
+    void visitVariableExpr(VariableExpr& expr) override {
+        invariant = !writes.writes(expr.name.symbol);
+        readsVariable = true;
+    }
+
+    void visitUnaryExpr(UnaryExpr& expr) override {
+        classify(*expr.right);
+    }
+
+    void visitBinaryExpr(BinaryExpr& expr) override {
+        bool left = classify(*expr.left);
+        bool leftReads = readsVariable;
+        bool right = classify(*expr.right);
+        bool rightReads = readsVariable;
+
+        bool cannotFail = expr.op.type != TokenType::SLASH || isNonZeroLiteral(expr.right);
+        invariant = left && right && cannotFail;
+        readsVariable = leftReads || rightReads;
+        if (!invariant) {
+            // Hoist the largest invariant pieces of a variant (or possibly failing) expression.
+            if (left && leftReads) replace(expr.left);
+            if (right && rightReads) replace(expr.right);
+        }
+    }
+
+    void visitAssignmentExpr(AssignmentExpr& expr) override {
+        hoistRoot(expr.value);
+        invariant = false;
+        readsVariable = true;
+    }
+
+    // StmtVisitor implementations
+    void visitExpressionStmt(ExpressionStmt& stmt) override { hoistRoot(stmt.expression); }
+    void visitVariableDeclarationStmt(VariableDeclarationStmt& stmt) override {
+        if (stmt.initializer) hoistRoot(stmt.initializer);
+    }
+    void visitBlockStmt(BlockStmt& stmt) override {
+        for (const auto& statement : stmt.statements) statement->accept(*this);
+    }
+    void visitIfStmt(IfStmt& stmt) override {
+        hoistRoot(stmt.condition);
+        stmt.thenBranch->accept(*this);
+        if (stmt.elseBranch) stmt.elseBranch->accept(*this);
+    }
+    void visitWhileStmt(WhileStmt& stmt) override {
+        hoistRoot(stmt.condition);
+        stmt.body->accept(*this);
+    }
+    void visitPrintStmt(PrintStmt& stmt) override { hoistRoot(stmt.expression); }
+};
+
+class LoopAnalyzer : public StmtVisitor {
+public:
+    explicit LoopAnalyzer(bool hoist = true) : hoistInvariants(hoist) {}
+
+    void analyze(std::vector<std::unique_ptr<Stmt>>& statements) {
+        analyzeList(statements);
+    }
+
+    const std::vector<LoopInfo>& loops() const { return infos; }
+
+    size_t expressionsHoisted() const {
+        size_t total = 0;
+        for (const LoopInfo& info : infos) total += info.hoisted;
+        return total;
+    }
+
+    void report(std::ostream& out) const {
+        for (const LoopInfo& info : infos) {
+            out << "Loop at line " << info.line << ": writes";
+            for (const std::string& name : info.written) out << " " << name;
+            for (size_t i = 0; i < info.inductions.size(); ++i) {
+                const InductionVariable& induction = info.inductions[i];
+                out << (i == 0 ? "; induction " : ", ") << induction.name;
+                if (induction.knownStart) out << " from " << induction.start;
+                out << " step " << induction.step;
+            }
+            if (info.tripCount >= 0) out << "; " << info.tripCount << " iterations";
+            if (info.hoisted > 0) out << "; hoisted " << info.hoisted;
+            out << "\n";
+        }
+    }
+
+private:
+    bool hoistInvariants;
+    size_t nextTemporary = 0;
+    std::vector<LoopInfo> infos;
+
+    // The statements before the one being visited in its list, for induction start values.
+    const std::vector<Stmt*>* previous = nullptr;
+    // Temporaries hoisted out of the loop just visited; analyze() wraps them and the loop in a block.
+    std::vector<std::unique_ptr<Stmt>> hoisted;
+
+    void analyze(std::unique_ptr<Stmt>& stmt) {
+        stmt->accept(*this);
+        if (!hoisted.empty()) {
+            int line = stmt->line;
+            hoisted.push_back(std::move(stmt));
+            stmt = std::make_unique<BlockStmt>(std::move(hoisted));
+            stmt->line = line;
+            hoisted.clear();
+        }
+    }
+
+    void analyzeList(std::vector<std::unique_ptr<Stmt>>& statements) {
+        std::vector<Stmt*> before;
+        before.reserve(statements.size());
+        for (auto& stmt : statements) {
+            Stmt* current = stmt.get();
+            previous = &before;
+            analyze(stmt);
+            before.push_back(current);
+        }
+    }
+
+    void analyzeNested(std::unique_ptr<Stmt>& stmt) {
+        previous = nullptr;
+        analyze(stmt);
+    }
+
+    // Finds the value name holds when the loop starts: the last earlier statement of the same
+    // list that writes it must be a constant `name = c` or `let name = c`.
+    bool startValue(uint32_t name, double& value) const {
+        if (!previous) return false;
+        for (size_t i = previous->size(); i > 0; --i) {
+            Stmt* stmt = (*previous)[i - 1];
+            if (assignsConstant(stmt, name, value)) return true;
+            LoopWriteCollector writes;
+            writes.collect(*stmt);
+            if (writes.writes(name)) return false;
+        }
+        return false;
+    }
+
+    // Finds the constant `i = c` or `let i = c` that stmt performs, if any.
+    static bool assignsConstant(Stmt* stmt, uint32_t name, double& value) {
+        std::unique_ptr<Expr>* source = nullptr;
+        if (auto declaration = dynamic_cast<VariableDeclarationStmt*>(stmt)) {
+            if (declaration->name.symbol != name) return false;
+            if (!declaration->initializer) {
+                value = 0;
+                return true;
+            }
+            source = &declaration->initializer;
+        } else if (auto expression = dynamic_cast<ExpressionStmt*>(stmt)) {
+            auto assignment = dynamic_cast<AssignmentExpr*>(expression->expression.get());
+            if (!assignment || assignment->name.symbol != name) return false;
+            source = &assignment->value;
+        } else {
+            return false;
+        }
+        auto literal = dynamic_cast<LiteralExpr*>(source->get());
+        if (!literal) return false;
+        value = literal->value;
+        return true;
+    }
+
+    // Recognizes `name = name + c`, `name = c + name` or `name = name - c` and returns c.
+    static bool isIncrement(Stmt& stmt, uint32_t& name, double& step) {
+        auto expression = dynamic_cast<ExpressionStmt*>(&stmt);
+        if (!expression) return false;
+        auto assignment = dynamic_cast<AssignmentExpr*>(expression->expression.get());
+        if (!assignment) return false;
+        auto binary = dynamic_cast<BinaryExpr*>(assignment->value.get());
+        if (!binary) return false;
+
+        auto isTarget = [&](const std::unique_ptr<Expr>& expr) {
+            auto variable = dynamic_cast<VariableExpr*>(expr.get());
+            return variable && variable->name.symbol == assignment->name.symbol;
+        };
+        auto leftLiteral = dynamic_cast<LiteralExpr*>(binary->left.get());
+        auto rightLiteral = dynamic_cast<LiteralExpr*>(binary->right.get());
+
+        if (binary->op.type == TokenType::PLUS && isTarget(binary->left) && rightLiteral) {
+            step = rightLiteral->value;
+        } else if (binary->op.type == TokenType::PLUS && isTarget(binary->right) && leftLiteral) {
+            step = leftLiteral->value;
+        } else if (binary->op.type == TokenType::MINUS && isTarget(binary->left) && rightLiteral) {
+            step = -rightLiteral->value;
+        } else {
+            return false;
+        }
+        name = assignment->name.symbol;
+        return step != 0 && std::isfinite(step);
+    }
+
+    // Collects every basic induction variable of the loop; the trip count comes from the one
+    // the condition compares with a constant, whichever statement updates it.
+    void findInductions(WhileStmt& loop, const LoopWriteCollector& writes, LoopInfo& info) {
+        // The update has to run exactly once per iteration: a direct statement of the body.
+        std::vector<Stmt*> body;
+        if (auto block = dynamic_cast<BlockStmt*>(loop.body.get())) {
+            for (const auto& stmt : block->statements) body.push_back(stmt.get());
+        } else {
+            body.push_back(loop.body.get());
+        }
+
+        for (Stmt* stmt : body) {
+            uint32_t name = 0;
+            double step = 0;
+            if (!isIncrement(*stmt, name, step)) continue;
+            auto count = writes.assignments.find(name);
+            if (count->second != 1 || writes.declared.count(name)) continue;
+
+            InductionVariable induction;
+            induction.name = std::string(SymbolTable::global().name(name));
+            induction.step = step;
+            if (startValue(name, induction.start)) {
+                induction.knownStart = true;
+                long long count = tripCount(loop, name, induction.start, step);
+                if (count >= 0) {
+                    info.tripCount = count;
+                    loop.tripCount = count;
+                }
+            }
+            info.inductions.push_back(std::move(induction));
+        }
+    }
+
+    // Iterations of `while (name op bound)` from start in steps of step; -1 when unknown.
+    // Only computed when every value the variable takes is an exactly representable integer.
+    static long long tripCount(WhileStmt& loop, uint32_t name, double start, double step) {
+        auto condition = dynamic_cast<BinaryExpr*>(loop.condition.get());
+        if (!condition) return -1;
+
+        TokenType op = condition->op.type;
+        auto variable = dynamic_cast<VariableExpr*>(condition->left.get());
+        auto literal = dynamic_cast<LiteralExpr*>(condition->right.get());
+        if (!variable || !literal) {
+            // c op i is i op' c with the comparison mirrored.
+            variable = dynamic_cast<VariableExpr*>(condition->right.get());
+            literal = dynamic_cast<LiteralExpr*>(condition->left.get());
+            switch (op) {
+                case TokenType::LESS: op = TokenType::GREATER; break;
+                case TokenType::LESS_EQUAL: op = TokenType::GREATER_EQUAL; break;
+                case TokenType::GREATER: op = TokenType::LESS; break;
+                case TokenType::GREATER_EQUAL: op = TokenType::LESS_EQUAL; break;
+                default: break;
+            }
+        }
+        if (!variable || !literal || variable->name.symbol != name) return -1;
+
+        const double limit = 9007199254740992.0;  // 2^53
+        double bound = literal->value;
+        for (double value : {start, step, bound}) {
+            if (value != std::trunc(value) || std::fabs(value) > limit / 4) return -1;
+        }
+        long long i = static_cast<long long>(start);
+        long long s = static_cast<long long>(step);
+        long long n = static_cast<long long>(bound);
+
+        switch (op) {
+            case TokenType::LESS:
+                if (i >= n) return 0;
+                return s > 0 ? (n - i + s - 1) / s : -1;
+            case TokenType::LESS_EQUAL:
+                if (i > n) return 0;
+                return s > 0 ? (n - i) / s + 1 : -1;
+            case TokenType::GREATER:
+                if (i <= n) return 0;
+                return s < 0 ? (i - n - s - 1) / -s : -1;
+            case TokenType::GREATER_EQUAL:
+                if (i < n) return 0;
+                return s < 0 ? (i - n) / -s + 1 : -1;
+            case TokenType::BANG_EQUAL:
+                if (i == n) return 0;
+                return (n - i) % s == 0 && (n - i) / s > 0 ? (n - i) / s : -1;
+            default:
+                return -1;
+        }
+    }
+
+    // StmtVisitor implementations
+    void visitExpressionStmt(ExpressionStmt&) override {}
+
+    void visitVariableDeclarationStmt(VariableDeclarationStmt&) override {}
+
+    void visitBlockStmt(BlockStmt& stmt) override {
+        analyzeList(stmt.statements);
+    }
+
+    void visitIfStmt(IfStmt& stmt) override {
+        analyzeNested(stmt.thenBranch);
+        if (stmt.elseBranch) {
+            analyzeNested(stmt.elseBranch);
+        }
+    }
+
+    void visitWhileStmt(WhileStmt& stmt) override {
+        const std::vector<Stmt*>* before = previous;
+        analyzeNested(stmt.body);  // inner loops first, so their temporaries can move further out
+        previous = before;
+
+        LoopWriteCollector writes;
+        writes.collect(stmt);
+
+        LoopInfo info;
+        info.line = stmt.line;
+        SymbolTable& symbols = SymbolTable::global();
+        for (const auto& entry : writes.assignments) info.written.emplace_back(symbols.name(entry.first));
+        for (uint32_t name : writes.declared) {
+            if (!writes.assignments.count(name)) info.written.emplace_back(symbols.name(name));
+        }
+        std::sort(info.written.begin(), info.written.end());
+        findInductions(stmt, writes, info);
+
+        if (hoistInvariants) {
+            InvariantHoister hoister(writes, stmt.line, nextTemporary);
+            hoister.hoist(stmt);
+            info.hoisted = hoister.temporaries.size();
+            hoisted = std::move(hoister.temporaries);
+        }
+        infos.push_back(std::move(info));
+    }
+
+    void visitPrintStmt(PrintStmt&) override {}
+};
+#endif
@@ -1,8 +1,21 @@
 // g++ -std=c++17 -o cameleon main.cpp 
 
-#include "enviroment_interpretation.cpp"
+#include "bytecode_vm.cpp"
+#include "flat_ast.cpp"
+#include "jit_x86_64.cpp"
+#include "batch_runner.cpp"
+#include "script_cache.cpp"
+#include "parallel_parser.cpp"
+#include "batch_simd.cpp"
+#include "repl.cpp"
+#include "resumable_interpreter.cpp"
+#include "tiered_execution.cpp"
+#include "closure_compiler.cpp"
+#include "ssa_ir.cpp"
+#include "iterative_interpreter.cpp"
+#include <fstream>
 
-int main() {
+int main(int argc, char* argv[]) {
     std::string source = R"(
         let x = 5;
         let y = 10;
@@ -16,16 +29,406 @@ int main() {
             print x;
         }
         print y;
+        let steps = 0;
+        let i = 0;
+        while (i < 4) {
+            steps = steps + 2;
+            i = i + 1;
+        }
+        print steps;
     )";
 
-    Lexer lexer(source);
-    std::vector<Token> tokens = lexer.scanTokens();
+    // --repl starts an interactive session instead of running a program.
+    // --vm runs the program on the bytecode VM instead of the tree-walking interpreter,
+    // --flat on the flat AST evaluator, --closures as a tree of pre-bound closures, --jit as native
+    // code (x86-64 Linux only), --ssa on the register machine after the SSA optimizations.
+    // --dump-ir writes the SSA form after lowering and after every pass, and the register code.
+    // --iterative runs the program without recursion, for programs nested too deeply for the other
+    // backends; the optimizer is skipped (it still recurses), and --parse-stats reports the depth.
+    // -O0, -O1 (default) or -O2 picks the optimization level; -O2 also hoists loop invariants.
+    // --parse-stats reports how much memory the syntax tree takes (and, with --vm, how many
+    // statements were fused into superinstructions).
+    // --no-fuse disables the VM's superinstructions.
+    // --tier <n> moves every loop of the tree-walking interpreter to the VM once it has run n iterations
+    // (--parse-stats lists the promoted loops).
+    // --stream <file> lexes and parses a script file incrementally instead of the built-in program.
+    // --flush=exit|size|line picks when printed output is flushed (default: size).
+    // --batch <file> runs every script listed in the file (one path per line, repeats allowed)
+    // concurrently on --threads <n> threads (default: all cores) and prints their outputs in order.
+    // With --slice <steps> the batch instead runs on this thread, each script in turn for that many
+    // steps at a time, or for --slice-us <microseconds> at most; --step-limit <steps> stops any script
+    // that runs longer.
+    // --parallel-parse parses the program on --threads <n> threads (the whole source is read first).
+    // --rows <file> runs the program once per row of a CSV file whose header names top-level `let`
+    // variables; each row starts those variables with its values, and all rows run at once in SIMD lanes.
+    // --cache <dir> reuses the compiled program from a cache directory when the source is unchanged.
+    // --profile-out <file> writes a collapsed-stack file for flame graphs (needs -DPROFILE_INTERPRETER).
+    std::string backend = "walk";
+    std::string streamPath;
+    std::string profilePath;
+    std::string batchPath;
+    std::string cacheDirectory;
+    std::string rowsPath;
+    size_t threads = std::thread::hardware_concurrency();
+    size_t sliceSteps = 0;
+    size_t sliceMicroseconds = 0;
+    size_t stepLimit = 0;
+    int optimizationLevel = 1;
+    bool parseStats = false;
+    bool dumpIr = false;
+    bool fuse = true;
+    bool parallelParse = false;
+    bool repl = false;
+    size_t tierThreshold = 0;
+    bool tiered = false;
+    FlushPolicy flushPolicy = FlushPolicy::THRESHOLD;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--vm") backend = "vm";
+        if (arg == "--flat") backend = "flat";
+        if (arg == "--closures") backend = "closures";
+        if (arg == "--jit") backend = "jit";
+        if (arg == "--ssa") backend = "ssa";
+        if (arg == "--iterative") backend = "iterative";
+        if (arg == "--dump-ir") dumpIr = true;
+        if (arg.size() == 3 && arg[0] == '-' && arg[1] == 'O') optimizationLevel = arg[2] - '0';
+        if (arg == "--parse-stats") parseStats = true;
+        if (arg == "--no-fuse") fuse = false;
+        if (arg == "--parallel-parse") parallelParse = true;
+        if (arg == "--repl") repl = true;
+        if (arg == "--tier" && i + 1 < argc) {
+            tiered = true;
+            tierThreshold = std::stoul(argv[++i]);
+        }
+        if (arg == "--stream" && i + 1 < argc) streamPath = argv[++i];
+        if (arg == "--profile-out" && i + 1 < argc) profilePath = argv[++i];
+        if (arg == "--batch" && i + 1 < argc) batchPath = argv[++i];
+        if (arg == "--cache" && i + 1 < argc) cacheDirectory = argv[++i];
+        if (arg == "--rows" && i + 1 < argc) rowsPath = argv[++i];
+        if (arg == "--threads" && i + 1 < argc) threads = std::stoul(argv[++i]);
+        if (arg == "--slice" && i + 1 < argc) sliceSteps = std::stoul(argv[++i]);
+        if (arg == "--slice-us" && i + 1 < argc) sliceMicroseconds = std::stoul(argv[++i]);
+        if (arg == "--step-limit" && i + 1 < argc) stepLimit = std::stoul(argv[++i]);
+        if (arg == "--flush=exit") flushPolicy = FlushPolicy::ON_EXIT;
+        if (arg == "--flush=size") flushPolicy = FlushPolicy::THRESHOLD;
+        if (arg == "--flush=line") flushPolicy = FlushPolicy::LINE;
+    }
+    // The optimizer and the loop analyzer still recurse, so the iterative backend skips them. This
+    // is settled before anything (the cache key in particular) depends on the level.
+    if (backend == "iterative") {
+        optimizationLevel = 0;
+    }
+
+    if (repl) {
+        Repl session;
+        session.run();
+        return 0;
+    }
+
+    if (!batchPath.empty()) {
+        std::ifstream list(batchPath);
+        if (!list) {
+            std::cerr << "Could not open '" << batchPath << "'\n";
+            return 1;
+        }
+        std::vector<BatchJob> jobs;
+        std::unordered_map<std::string, std::string> sources;
+        std::string path;
+        while (std::getline(list, path)) {
+            if (path.empty()) continue;
+            auto it = sources.find(path);
+            if (it == sources.end()) {
+                std::ifstream file(path);
+                if (!file) {
+                    std::cerr << "Could not open '" << path << "'\n";
+                    return 1;
+                }
+                std::stringstream contents;
+                contents << file.rdbuf();
+                it = sources.emplace(path, contents.str()).first;
+            }
+            jobs.push_back({path, it->second});
+        }
+
+        if (sliceSteps > 0 || sliceMicroseconds > 0 || stepLimit > 0) {
+            // A time slice on its own leaves the step count unbounded, so the clock alone ends each turn.
+            size_t steps = sliceSteps > 0 ? sliceSteps : 10000;
+            if (sliceSteps == 0 && sliceMicroseconds > 0) steps = std::numeric_limits<size_t>::max();
+            ScriptMultiplexer multiplexer(steps, stepLimit, optimizationLevel,
+                                          std::chrono::microseconds(sliceMicroseconds));
+            for (const BatchJob& job : jobs) {
+                multiplexer.add(job.name, job.source);
+            }
+            std::vector<BatchResult> results = multiplexer.run();
+            for (const BatchResult& result : results) {
+                std::cout << "== " << result.name << "\n" << result.output;
+                std::cerr << result.errors;
+            }
+            const MultiplexStats& stats = multiplexer.stats();
+            std::cerr << "Multiplex: " << stats.scripts << " scripts, " << stats.slices << " slices, " << stats.steps
+                      << " steps, " << stats.killed << " killed, longest slice " << stats.longestSliceSeconds * 1e6
+                      << " us, total " << stats.seconds * 1000.0 << " ms\n";
+            return 0;
+        }
+
+        BatchRunner runner(threads, optimizationLevel);
+        std::vector<BatchResult> results = runner.run(jobs);
+        for (const BatchResult& result : results) {
+            std::cout << "== " << result.name << "\n" << result.output;
+            std::cerr << result.errors;
+        }
+        const BatchStats& stats = runner.stats();
+        std::cerr << "Batch: " << stats.jobs << " jobs, " << stats.scripts << " scripts, " << stats.threads
+                  << " threads, " << stats.steals << " steals, prepare " << stats.prepareSeconds * 1000.0
+                  << " ms, run " << stats.runSeconds * 1000.0 << " ms, AST "
+                  << (stats.astUnchanged ? "unchanged" : "MUTATED") << "\n";
+        return stats.astUnchanged ? 0 : 1;
+    }
+
+    // The arena owns every node of the tree, so it is declared before (and destroyed after) it.
+    AstArena arena;
+    std::vector<std::unique_ptr<Stmt>> statements;
+    size_t globalSlots = 0;
+    size_t parseDepth = 0;
+
+    // With a cache the whole source is needed up front to compute its key, and the parallel
+    // parser needs every token before it can split them.
+    if ((!cacheDirectory.empty() || parallelParse) && !streamPath.empty()) {
+        std::ifstream file(streamPath);
+        if (!file) {
+            std::cerr << "Could not open '" << streamPath << "'\n";
+            return 1;
+        }
+        std::stringstream contents;
+        contents << file.rdbuf();
+        source = contents.str();
+        streamPath.clear();
+    }
+
+    std::unique_ptr<ScriptCache> cache;
+    bool cached = false;
+    if (!cacheDirectory.empty()) {
+        cache = std::make_unique<ScriptCache>(cacheDirectory, optimizationLevel);
+        cached = cache->load(source, arena, statements, globalSlots);
+    }
+
+    if (!cached) {
+        auto compileStart = std::chrono::steady_clock::now();
+        if (!streamPath.empty()) {
+            std::ifstream file(streamPath);
+            if (!file) {
+                std::cerr << "Could not open '" << streamPath << "'\n";
+                return 1;
+            }
+            StreamingLexer lexer(file);
+            Parser parser(lexer);
+            statements = parser.parse(arena);
+            parseDepth = parser.maxDepth();
+        } else if (parallelParse) {
+            Lexer lexer(source);
+            std::vector<Token> tokens = lexer.scanTokens();
+
+            ParallelParser parser(threads);
+            statements = parser.parse(tokens, arena);
+            if (parseStats) {
+                const ParallelParseStats& stats = parser.stats();
+                std::cerr << "Parallel parse: " << stats.tokens << " tokens, " << stats.chunks << " chunks on "
+                          << stats.threads << " threads, " << stats.reparsed << " re-parsed, "
+                          << stats.seconds * 1000.0 << " ms\n";
+            }
+        } else {
+            Lexer lexer(source);
+            std::vector<Token> tokens = lexer.scanTokens();
+
+            Parser parser(tokens);
+            statements = parser.parse(arena);
+            parseDepth = parser.maxDepth();
+        }
+
+        if (parseStats) {
+            std::cerr << "AST: " << arena.nodeCount() << " nodes, " << arena.bytesAllocated()
+                      << " bytes (" << arena.bytesReserved() << " reserved)\n";
+        }
+
+        // Undefined names are reported before the optimizer can drop the code that uses them.
+        Resolver resolver;
+        if (optimizationLevel > 0 && !resolver.check(statements)) {
+            releaseTree(statements);
+            return 1;
+        }
+
+        Optimizer optimizer(optimizationLevel);
+        optimizer.optimize(statements);
+        if (parseStats) {
+            std::cerr << "Optimizer: removed " << optimizer.nodesRemoved() << " nodes\n";
+        }
+
+        // Loop analysis works on names, so it runs before resolution.
+        LoopAnalyzer loopAnalyzer(optimizationLevel >= 2);
+        if (optimizationLevel >= 1) {
+            loopAnalyzer.analyze(statements);
+        }
+        if (parseStats) {
+            loopAnalyzer.report(std::cerr);
+        }
+
+        // Bind every variable to a frame slot; undefined names are reported before anything runs.
+        if (!resolver.resolve(statements)) {
+            releaseTree(statements);
+            return 1;
+        }
+        globalSlots = resolver.globalSlotCount();
+
+        if (cache) {
+            double compileSeconds =
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - compileStart).count();
+            bool stored = cache->store(source, statements, globalSlots, compileSeconds);
+            std::cerr << "Cache " << cache->lastResult() << ": compiled in " << compileSeconds * 1000.0 << " ms"
+                      << (stored ? ", stored " : ", could not write ") << cache->pathFor(source) << "\n";
+        }
+    } else {
+        std::cerr << "Cache hit: loaded in " << cache->lastLoadSeconds() * 1000.0 << " ms, saved "
+                  << cache->lastSavedSeconds() * 1000.0 << " ms\n";
+    }
+
+    if (!rowsPath.empty()) {
+        std::ifstream file(rowsPath);
+        if (!file) {
+            std::cerr << "Could not open '" << rowsPath << "'\n";
+            return 1;
+        }
+        std::vector<ColumnInput> inputs;
+        std::string line;
+        if (std::getline(file, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            std::stringstream header(line);
+            std::string name;
+            while (std::getline(header, name, ',')) inputs.push_back({name, {}});
+        }
+        size_t rows = 0;
+        while (std::getline(file, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty()) continue;
+            std::stringstream fields(line);
+            std::string field;
+            for (ColumnInput& input : inputs) {
+                if (!std::getline(fields, field, ',')) {
+                    std::cerr << "Row " << rows + 1 << " has no value for column '" << input.name << "'\n";
+                    return 1;
+                }
+                // An empty cell starts the variable at 0; anything else must parse as a number in full.
+                double value = 0.0;
+                size_t used = 0;
+                try {
+                    if (!field.empty()) value = std::stod(field, &used);
+                } catch (const std::exception&) {
+                    used = 0;
+                }
+                if (used != field.size()) {
+                    std::cerr << "Row " << rows + 1 << ", column '" << input.name << "': '" << field
+                              << "' is not a number\n";
+                    return 1;
+                }
+                input.values.push_back(value);
+            }
+            if (std::getline(fields, field, ',')) {
+                std::cerr << "Row " << rows + 1 << " has more values than the header has columns\n";
+                return 1;
+            }
+            rows++;
+        }
 
-    Parser parser(tokens);
-    auto statements = parser.parse();
+        ColumnInterpreter interpreter;
+        std::vector<BatchResult> results;
+        try {
+            results = interpreter.run(statements, globalSlots, inputs, rows);
+        } catch (const std::runtime_error& error) {
+            std::cerr << error.what() << "\n";
+            return 1;
+        }
+        for (const BatchResult& result : results) {
+            std::cout << "== " << result.name << "\n" << result.output;
+            std::cerr << result.errors;
+        }
+        const ColumnStats& stats = interpreter.stats();
+        std::cerr << "Rows: " << stats.rows << " rows, " << stats.failedRows << " failed, " << stats.kernel << " kernels ("
+                  << stats.lanes << " lanes), " << stats.seconds * 1000.0 << " ms\n";
+        return 0;
+    }
 
-    Interpreter interpreter;
-    interpreter.interpret(statements);
+    if (backend == "vm") {
+        VM vm(std::cout, flushPolicy, fuse);
+        vm.interpret(statements);
+        if (parseStats) {
+            const FusionStats& stats = vm.fusionStats();
+            std::cerr << "Fusion: " << stats.fused() << " of " << stats.candidates << " statements/conditions fused ("
+                      << stats.addLocalConst << " add-local-const, " << stats.binaryLocals << " binary-locals, "
+                      << stats.compareJumps << " compare-jump)\n";
+        }
+    } else if (backend == "flat") {
+        FlatAstBuilder builder;
+        FlatProgram program = builder.build(statements, globalSlots);
+        if (parseStats) {
+            std::cerr << "Flat AST: " << program.nodes.size() << " nodes, " << program.memoryBytes() << " bytes\n";
+        }
+        FlatEvaluator evaluator(std::cout, flushPolicy);
+        evaluator.interpret(program);
+    } else if (backend == "closures") {
+        ClosureCompiler compiler;
+        ClosureProgram program = compiler.compile(statements, globalSlots);
+        if (parseStats) {
+            std::cerr << "Closures: " << program.closures << " closures, " << program.slotCount << " slots\n";
+        }
+        ClosureEvaluator evaluator(std::cout, flushPolicy);
+        evaluator.interpret(program);
+    } else if (backend == "ssa") {
+        SsaCompiler compiler(dumpIr ? &std::cerr : nullptr);
+        RegisterProgram program = compiler.compile(statements, globalSlots);
+        if (parseStats) {
+            const SsaStats& stats = compiler.stats();
+            std::cerr << "SSA: " << stats.lowered << " values lowered, " << stats.copies << " copies propagated, "
+                      << stats.phis << " phis removed, " << stats.numbered << " redundant values numbered, "
+                      << stats.folded << " folded, " << stats.dead << " dead; " << stats.optimized << " values in "
+                      << stats.instructions << " instructions, " << stats.registers << " registers, " << stats.spilled
+                      << " spills\n";
+        }
+        RegisterVM vm(std::cout, flushPolicy);
+        vm.run(program);
+    } else if (backend == "iterative") {
+        IterativeInterpreter interpreter(std::cout, flushPolicy);
+        interpreter.interpret(statements, globalSlots);
+        if (parseStats) {
+            std::cerr << "Depth: " << parseDepth << " while parsing, " << interpreter.maxDepth()
+                      << " while running\n";
+        }
+    } else if (backend == "jit") {
+        JitEngine jit(std::cout, flushPolicy);
+        if (!jit.run(statements, globalSlots) && parseStats) {
+            std::cerr << "JIT: unsupported program, ran the interpreter instead\n";
+        }
+    } else {
+        Interpreter interpreter(std::cout, flushPolicy);
+        BytecodeLoopTier tier(fuse);
+        if (tiered) {
+            interpreter.setLoopTier(&tier, tierThreshold);
+        }
+        interpreter.interpret(statements);
+        if (tiered && parseStats) {
+            tier.report(std::cerr);
+        }
+#ifdef PROFILE_INTERPRETER
+        interpreter.getProfiler().report(std::cerr);
+        if (!profilePath.empty() && !interpreter.getProfiler().writeCollapsed(profilePath)) {
+            std::cerr << "Could not write '" << profilePath << "'\n";
+        }
+#else
+        if (!profilePath.empty()) {
+            std::cerr << "Profiling is not compiled in; rebuild with -DPROFILE_INTERPRETER\n";
+        }
+#endif
+    }
 
+    // Without recursion, so that a tree of any depth can be torn down.
+    releaseTree(statements);
     return 0;
-}
\ No newline at end of file
+}
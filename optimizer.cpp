@@ -0,0 +1,283 @@
+#include "parsing.cpp"
+#include <algorithm>
+#include <cmath>
+
+// 3a. Optimization (Optimizer)
+// An optional pass between parsing and execution that rewrites the AST in place.
+//   level 0: nothing
+//   level 1: fold constant subexpressions
+//   level 2: also apply IEEE-safe algebraic identities and drop dead branches,
+//            constant expression statements and empty blocks
+// Divisions by a zero constant are never folded, so they still fail at runtime with their line.
+
+#ifndef OPTIMIZER
+#define OPTIMIZER
+
+// Counts the nodes of a tree.
+class NodeCounter : public ExprVisitor, public StmtVisitor {
+public:
+    size_t count(const std::vector<std::unique_ptr<Stmt>>& statements) {
+        nodes = 0;
+        for (const auto& stmt : statements) {
+            stmt->accept(*this);
+        }
+        return nodes;
+    }
+
+private:
+    size_t nodes = 0;
+
+    void visitLiteralExpr(LiteralExpr&) override { nodes++; }
+    void visitVariableExpr(VariableExpr&) override { nodes++; }
+    void visitUnaryExpr(UnaryExpr& expr) override { nodes++; expr.right->accept(*this); }
+    void visitBinaryExpr(BinaryExpr& expr) override {
+        nodes++;
+        expr.left->accept(*this);
+        expr.right->accept(*this);
+    }
+    void visitAssignmentExpr(AssignmentExpr& expr) override { nodes++; expr.value->accept(*this); }
+
+    void visitExpressionStmt(ExpressionStmt& stmt) override { nodes++; stmt.expression->accept(*this); }
+    void visitVariableDeclarationStmt(VariableDeclarationStmt& stmt) override {
+        nodes++;
+        if (stmt.initializer) stmt.initializer->accept(*this);
+    }
+    void visitBlockStmt(BlockStmt& stmt) override {
+        nodes++;
+        for (const auto& statement : stmt.statements) statement->accept(*this);
+    }
+    void visitIfStmt(IfStmt& stmt) override {
+        nodes++;
+        stmt.condition->accept(*this);
+        stmt.thenBranch->accept(*this);
+        if (stmt.elseBranch) stmt.elseBranch->accept(*this);
+    }
+    void visitWhileStmt(WhileStmt& stmt) override {
+        nodes++;
+        stmt.condition->accept(*this);
+        stmt.body->accept(*this);
+    }
+    void visitPrintStmt(PrintStmt& stmt) override { nodes++; stmt.expression->accept(*this); }
+};
+
+class Optimizer : public ExprVisitor, public StmtVisitor {
+public:
+    explicit Optimizer(int level = 1) : level(level) {}
+
+    void optimize(std::vector<std::unique_ptr<Stmt>>& statements) {
+        if (level <= 0) return;
+
+        NodeCounter counter;
+        size_t before = counter.count(statements);
+        optimizeList(statements);
+        removed += before - counter.count(statements);
+    }
+
+    size_t nodesRemoved() const { return removed; }
+
+private:
+    int level;
+    size_t removed = 0;
+
+    // A visit method stores a replacement for the node it was called on here.
+    std::unique_ptr<Expr> exprReplacement;
+    std::unique_ptr<Stmt> stmtReplacement;
+    bool stmtReplaced = false;
+
+    void optimize(std::unique_ptr<Expr>& expr) {
+        expr->accept(*this);
+        if (exprReplacement) {
+            expr = std::move(exprReplacement);
+        }
+    }
+
+    // Leaves stmt empty when the statement can be dropped.
+    void optimize(std::unique_ptr<Stmt>& stmt) {
+        stmt->accept(*this);
+        if (stmtReplaced) {
+            stmtReplaced = false;
+            stmt = std::move(stmtReplacement);
+        }
+    }
+
+    void optimizeList(std::vector<std::unique_ptr<Stmt>>& statements) {
+        for (auto& stmt : statements) {
+            optimize(stmt);
+        }
+        statements.erase(std::remove(statements.begin(), statements.end(), nullptr), statements.end());
+    }
+
+    void replaceStmt(std::unique_ptr<Stmt> replacement) {
+        stmtReplacement = std::move(replacement);
+        stmtReplaced = true;
+    }
+
+    static LiteralExpr* asLiteral(const std::unique_ptr<Expr>& expr) {
+        return dynamic_cast<LiteralExpr*>(expr.get());
+    }
+
+    static bool isLiteral(const std::unique_ptr<Expr>& expr, double value) {
+        LiteralExpr* literal = asLiteral(expr);
+        return literal && literal->value == value && std::signbit(literal->value) == std::signbit(value);
+    }
+
+    static bool isEmptyBlock(const std::unique_ptr<Stmt>& stmt) {
+        auto block = dynamic_cast<BlockStmt*>(stmt.get());
+        return block && block->statements.empty();
+    }
+
+    // ExprVisitor implementations
+    void visitLiteralExpr(LiteralExpr&) override {}
+
+    void visitVariableExpr(VariableExpr&) override {}
+
+    void visitUnaryExpr(UnaryExpr& expr) override {
+        optimize(expr.right);
+
+        if (LiteralExpr* right = asLiteral(expr.right)) {
+            switch (expr.op.type) {
+                case TokenType::MINUS:
+                    exprReplacement = std::make_unique<LiteralExpr>(-right->value);
+                    return;
+                case TokenType::BANG:
+                    exprReplacement = std::make_unique<LiteralExpr>(right->value != 0.0 ? 0.0 : 1.0);
+                    return;
+                default:
+                    return;
+            }
+        }
+
+        // -(-x) is x for every double, including NaN and signed zeros.
+        if (level >= 2 && expr.op.type == TokenType::MINUS) {
+            auto inner = dynamic_cast<UnaryExpr*>(expr.right.get());
+            if (inner && inner->op.type == TokenType::MINUS) {
+                exprReplacement = std::move(inner->right);
+            }
+        }
+    }
+
+    void visitBinaryExpr(BinaryExpr& expr) override {
+        optimize(expr.left);
+        optimize(expr.right);
+
+        LiteralExpr* left = asLiteral(expr.left);
+        LiteralExpr* right = asLiteral(expr.right);
+        if (left && right) {
+            double a = left->value;
+            double b = right->value;
+            double value;
+            switch (expr.op.type) {
+                case TokenType::PLUS: value = a + b; break;
+                case TokenType::MINUS: value = a - b; break;
+                case TokenType::STAR: value = a * b; break;
+                case TokenType::SLASH:
+                    if (b == 0) return; // keep the runtime division-by-zero error
+                    value = a / b;
+                    break;
+                case TokenType::GREATER: value = a > b ? 1.0 : 0.0; break;
+                case TokenType::GREATER_EQUAL: value = a >= b ? 1.0 : 0.0; break;
+                case TokenType::LESS: value = a < b ? 1.0 : 0.0; break;
+                case TokenType::LESS_EQUAL: value = a <= b ? 1.0 : 0.0; break;
+                case TokenType::EQUAL_EQUAL: value = a == b ? 1.0 : 0.0; break;
+                case TokenType::BANG_EQUAL: value = a != b ? 1.0 : 0.0; break;
+                default: return;
+            }
+            exprReplacement = std::make_unique<LiteralExpr>(value);
+            return;
+        }
+
+        if (level < 2) return;
+
+        // Identities that hold for every double: x * 1, 1 * x, x / 1 and x - (+0) are x.
+        // (x + 0 and x * 0 are not safe: -0 + 0 is +0 and NaN * 0 is NaN.)
+        switch (expr.op.type) {
+            case TokenType::STAR:
+                if (isLiteral(expr.right, 1.0)) {
+                    exprReplacement = std::move(expr.left);
+                } else if (isLiteral(expr.left, 1.0)) {
+                    exprReplacement = std::move(expr.right);
+                }
+                break;
+            case TokenType::SLASH:
+                if (isLiteral(expr.right, 1.0)) exprReplacement = std::move(expr.left);
+                break;
+            case TokenType::MINUS:
+                if (isLiteral(expr.right, 0.0)) exprReplacement = std::move(expr.left);
+                break;
+            default:
+                break;
+        }
+    }
+
+    void visitAssignmentExpr(AssignmentExpr& expr) override {
+        optimize(expr.value);
+    }
+
+    // StmtVisitor implementations
+    void visitExpressionStmt(ExpressionStmt& stmt) override {
+        optimize(stmt.expression);
+        if (level >= 2 && asLiteral(stmt.expression)) {
+            replaceStmt(nullptr);
+        }
+    }
+
+    void visitVariableDeclarationStmt(VariableDeclarationStmt& stmt) override {
+        if (stmt.initializer) {
+            optimize(stmt.initializer);
+        }
+    }
+
+    void visitBlockStmt(BlockStmt& stmt) override {
+        optimizeList(stmt.statements);
+        if (level >= 2 && stmt.statements.empty()) {
+            replaceStmt(nullptr);
+        }
+    }
+
+    void visitIfStmt(IfStmt& stmt) override {
+        optimize(stmt.condition);
+        optimizeBranch(stmt.thenBranch);
+        if (stmt.elseBranch) {
+            optimize(stmt.elseBranch);
+        }
+
+        if (level < 2) return;
+
+        if (LiteralExpr* condition = asLiteral(stmt.condition)) {
+            replaceStmt(condition->value != 0.0 ? std::move(stmt.thenBranch) : std::move(stmt.elseBranch));
+            if (isEmptyBlock(stmtReplacement)) stmtReplacement.reset();
+            return;
+        }
+
+        if (isEmptyBlock(stmt.thenBranch) && !stmt.elseBranch) {
+            // Nothing left to run, but the condition may still fail or assign.
+            replaceStmt(std::make_unique<ExpressionStmt>(std::move(stmt.condition)));
+            stmtReplacement->line = stmt.line;
+        }
+    }
+
+    void visitWhileStmt(WhileStmt& stmt) override {
+        optimize(stmt.condition);
+        optimizeBranch(stmt.body);
+
+        if (level >= 2) {
+            LiteralExpr* condition = asLiteral(stmt.condition);
+            if (condition && condition->value == 0.0) {
+                replaceStmt(nullptr);
+            }
+        }
+    }
+
+    void visitPrintStmt(PrintStmt& stmt) override {
+        optimize(stmt.expression);
+    }
+
+    // A branch or loop body must stay a statement, so an emptied one becomes an empty block.
+    void optimizeBranch(std::unique_ptr<Stmt>& branch) {
+        optimize(branch);
+        if (!branch) {
+            branch = std::make_unique<BlockStmt>(std::vector<std::unique_ptr<Stmt>>());
+        }
+    }
+};
+#endif
@@ -0,0 +1,86 @@
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// 4b. Program Output (OutputBuffer)
+// `print` writes through this buffer instead of formatting into std::cout on every call.
+// Numbers are formatted with std::to_chars exactly as `std::cout << value` would print them
+// (general format, 6 significant digits), with a shortcut for whole numbers.
+
+#ifndef OUTPUT_BUFFER
+#define OUTPUT_BUFFER
+
+enum class FlushPolicy {
+    ON_EXIT,    // only when flush() is called or the buffer is destroyed; the buffer grows as needed
+    THRESHOLD,  // whenever the buffer reaches its capacity
+    LINE        // after every line, for interactive use
+};
+
+class OutputBuffer {
+public:
+    explicit OutputBuffer(std::ostream& sink, FlushPolicy policy = FlushPolicy::THRESHOLD,
+                          size_t capacity = 64 * 1024)
+        : sink(&sink), policy(policy), capacity(capacity) {
+        data.resize(capacity + kMaxNumberLength);
+    }
+
+    ~OutputBuffer() {
+        flush();
+    }
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    void setPolicy(FlushPolicy newPolicy) {
+        policy = newPolicy;
+    }
+
+    // Longest general-format double ("-1.23457e-308") plus a newline, with room to spare.
+    static constexpr size_t kMaxNumberLength = 32;
+
+    // Writes value and a newline, byte-for-byte like `std::cout << value << "\n"`.
+    void printNumber(double value) {
+        if (data.size() - used < kMaxNumberLength) {
+            data.resize(data.size() * 2);
+        }
+        used = formatNumber(value, data.data() + used) - data.data();
+
+        if (policy == FlushPolicy::LINE || (policy == FlushPolicy::THRESHOLD && used >= capacity)) {
+            flush();
+        }
+    }
+
+    void flush() {
+        if (used == 0) return;
+        sink->write(data.data(), static_cast<std::streamsize>(used));
+        sink->flush();
+        used = 0;
+    }
+
+    // Formats value and a newline into first, which needs room for kMaxNumberLength bytes,
+    // and returns the end of what was written.
+    static char* formatNumber(double value, char* first) {
+        char* last = first + kMaxNumberLength - 1;
+
+        // Whole numbers below 1e6 print without exponent or fraction in general format.
+        // -0.0 still goes through to_chars so it keeps its sign.
+        std::to_chars_result result;
+        if (value == std::trunc(value) && std::fabs(value) < 1e6 && (value != 0 || !std::signbit(value))) {
+            result = std::to_chars(first, last, static_cast<int64_t>(value));
+        } else {
+            result = std::to_chars(first, last, value, std::chars_format::general, 6);
+        }
+        *result.ptr = '\n';
+        return result.ptr + 1;
+    }
+
+private:
+    std::ostream* sink;
+    FlushPolicy policy;
+    size_t capacity;
+    std::vector<char> data;
+    size_t used = 0;
+};
+#endif
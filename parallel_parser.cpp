@@ -0,0 +1,148 @@
+#include "batch_runner.cpp"
+#include <chrono>
+
+// 12. Parallel Parsing (ParallelParser)
+// Parses a large token stream on several threads. The tokens are cut into chunks at top-level
+// statement boundaries: a `;` or `}` outside any braces or parentheses that is not followed by
+// `else`. Each chunk is parsed on its own into its own arena, and the statement lists are joined
+// in order. A chunk that parsed without an error is exactly what the sequential parser builds
+// from that point, so it is kept as is. Error recovery can run across a boundary, so from a
+// chunk with an error the tokens are parsed again sequentially until the parser stops at the
+// start of a clean chunk. The result, line numbers included, matches Parser::parse.
+
+#ifndef PARALLEL_PARSER
+#define PARALLEL_PARSER
+
+struct ParallelParseStats {
+    size_t tokens = 0;
+    size_t chunks = 0;
+    size_t reparsed = 0;  // chunks replaced by the sequential re-parse
+    size_t threads = 0;
+    double seconds = 0;
+};
+
+class ParallelParser {
+public:
+    explicit ParallelParser(size_t threads = std::thread::hardware_concurrency(), size_t minimumChunkTokens = 16 * 1024)
+        : threadCount(threads > 0 ? threads : 1), minimumChunkTokens(minimumChunkTokens) {}
+
+    // Every node ends up owned by arena, which must outlive the returned statements.
+    std::vector<std::unique_ptr<Stmt>> parse(const std::vector<Token>& tokens, AstArena& arena) {
+        auto start = std::chrono::steady_clock::now();
+        statistics = ParallelParseStats();
+        statistics.tokens = tokens.size();
+
+        std::vector<Chunk> chunks = split(tokens);
+        statistics.chunks = chunks.size();
+
+        WorkStealingPool pool(threadCount);
+        pool.run(chunks.size(), [&](size_t index) {
+            Chunk& chunk = chunks[index];
+            chunk.arena = std::make_unique<AstArena>();
+            Parser parser(tokens, chunk.begin, chunk.end);
+            chunk.statements = parser.parse(*chunk.arena);
+            chunk.clean = parser.errorCount() == 0;
+        });
+        statistics.threads = std::min(pool.threads(), chunks.size());
+
+        std::vector<std::unique_ptr<Stmt>> statements = join(tokens, chunks, arena);
+        for (Chunk& chunk : chunks) {
+            chunk.statements.clear();
+            arena.adopt(*chunk.arena);
+        }
+        statistics.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return statements;
+    }
+
+    const ParallelParseStats& stats() const { return statistics; }
+
+private:
+    struct Chunk {
+        size_t begin = 0;
+        size_t end = 0;  // one past the last token
+        std::unique_ptr<AstArena> arena;
+        std::vector<std::unique_ptr<Stmt>> statements;
+        bool clean = false;
+    };
+
+    size_t threadCount;
+    size_t minimumChunkTokens;
+    ParallelParseStats statistics;
+
+    // Cuts the tokens before END_OF_FILE into about four chunks per thread, each at least
+    // minimumChunkTokens long, ending at the first safe boundary past its target size.
+    std::vector<Chunk> split(const std::vector<Token>& tokens) const {
+        size_t last = tokens.size() - 1;  // END_OF_FILE
+        size_t target = std::max(minimumChunkTokens, last / (threadCount * 4) + 1);
+
+        std::vector<Chunk> chunks;
+        size_t begin = 0;
+        int depth = 0;
+        for (size_t i = 0; i < last; ++i) {
+            switch (tokens[i].type) {
+                case TokenType::LEFT_BRACE:
+                case TokenType::LEFT_PAREN:
+                    depth++;
+                    break;
+                case TokenType::RIGHT_BRACE:
+                case TokenType::RIGHT_PAREN:
+                    // A stray closer is a parse error, and error chunks are re-parsed anyway.
+                    if (depth > 0) depth--;
+                    break;
+                default:
+                    break;
+            }
+
+            bool boundary = depth == 0 && i + 1 < last &&
+                            (tokens[i].type == TokenType::SEMICOLON || tokens[i].type == TokenType::RIGHT_BRACE) &&
+                            tokens[i + 1].type != TokenType::ELSE;
+            if (boundary && i + 1 - begin >= target) {
+                chunks.push_back(makeChunk(begin, i + 1));
+                begin = i + 1;
+            }
+        }
+        chunks.push_back(makeChunk(begin, last));
+        return chunks;
+    }
+
+    static Chunk makeChunk(size_t begin, size_t end) {
+        Chunk chunk;
+        chunk.begin = begin;
+        chunk.end = end;
+        return chunk;
+    }
+
+    std::vector<std::unique_ptr<Stmt>> join(const std::vector<Token>& tokens, std::vector<Chunk>& chunks,
+                                            AstArena& arena) {
+        std::vector<std::unique_ptr<Stmt>> statements;
+        size_t next = 0;
+        size_t position = 0;
+        while (next < chunks.size()) {
+            Chunk& chunk = chunks[next];
+            if (chunk.begin == position && chunk.clean) {
+                for (auto& stmt : chunk.statements) statements.push_back(std::move(stmt));
+                position = chunk.end;
+                next++;
+                continue;
+            }
+
+            // Re-parse sequentially to the end of the file if need be, but stop as soon as a
+            // declaration ends at the start of a clean chunk.
+            ArenaScope scope(arena);
+            Parser parser(tokens, position, tokens.size() - 1);
+            while (!parser.finished()) {
+                auto stmt = parser.parseDeclaration();
+                if (stmt) statements.push_back(std::move(stmt));
+                position = parser.position();
+                while (next < chunks.size() && chunks[next].begin < position) {
+                    statistics.reparsed++;
+                    next++;
+                }
+                if (next < chunks.size() && chunks[next].begin == position && chunks[next].clean) break;
+            }
+            if (parser.finished()) break;
+        }
+        return statements;
+    }
+};
+#endif
@@ -1,14 +1,68 @@
 
 #include "abstract_syntax_tree.cpp"
+#include "streaming_lexer.cpp"
 /*3. Parsing (Parser)
 The parser consumes tokens and produces the AST.*/
 
 #ifndef PARSING
 #define PARSING
 
+// How tightly each infix operator binds, loosest first.
+enum class Precedence : uint8_t {
+    NONE,        // not an infix operator
+    ASSIGNMENT,  // =
+    EQUALITY,    // == !=
+    COMPARISON,  // > >= < <=
+    TERM,        // + -
+    FACTOR       // * /
+};
+
+// Infix precedence of every token type, built at compile time and indexed by TokenType.
+struct PrecedenceTable {
+    static constexpr size_t kSize = static_cast<size_t>(TokenType::END_OF_FILE) + 1;
+
+    Precedence entries[kSize] = {};
+
+    constexpr PrecedenceTable() {
+        set(TokenType::EQUAL, Precedence::ASSIGNMENT);
+        set(TokenType::BANG_EQUAL, Precedence::EQUALITY);
+        set(TokenType::EQUAL_EQUAL, Precedence::EQUALITY);
+        set(TokenType::GREATER, Precedence::COMPARISON);
+        set(TokenType::GREATER_EQUAL, Precedence::COMPARISON);
+        set(TokenType::LESS, Precedence::COMPARISON);
+        set(TokenType::LESS_EQUAL, Precedence::COMPARISON);
+        set(TokenType::MINUS, Precedence::TERM);
+        set(TokenType::PLUS, Precedence::TERM);
+        set(TokenType::SLASH, Precedence::FACTOR);
+        set(TokenType::STAR, Precedence::FACTOR);
+    }
+
+    constexpr Precedence operator[](TokenType type) const {
+        size_t index = static_cast<size_t>(type);
+        return index < kSize ? entries[index] : Precedence::NONE;
+    }
+
+private:
+    constexpr void set(TokenType type, Precedence precedence) {
+        entries[static_cast<size_t>(type)] = precedence;
+    }
+};
+
+static constexpr PrecedenceTable kPrecedenceTable{};
+
 class Parser {
 public:
-    Parser(const std::vector<Token>& tokens) : tokens(tokens) {}
+    Parser(const std::vector<Token>& tokens) : tokens(&tokens) {}
+
+    // Parses only tokens[begin, end), as if the token at end were the end of the file.
+    Parser(const std::vector<Token>& tokens, size_t begin, size_t end)
+        : tokens(&tokens), current(begin), end(end) {}
+
+    // Pulls tokens on demand instead of indexing a fully scanned vector.
+    Parser(TokenSource& source) : source(&source) {
+        Token first = source.next();
+        window.assign(kLookahead, first);
+    }
 
     std::vector<std::unique_ptr<Stmt>> parse() {
         std::vector<std::unique_ptr<Stmt>> statements;
@@ -21,24 +75,88 @@ public:
         return statements;
     }
 
+    // Parses with every node placed in the given arena. The arena must outlive the returned statements.
+    std::vector<std::unique_ptr<Stmt>> parse(AstArena& arena) {
+        ArenaScope scope(arena);
+        return parse();
+    }
+
+    // Parses a single top-level declaration; nullptr when it had an error and was skipped.
+    std::unique_ptr<Stmt> parseDeclaration() {
+        return declaration();
+    }
+
+    bool finished() { return isAtEnd(); }
+
+    // Index of the next token to parse (token-vector parsers only).
+    size_t position() const { return current; }
+
+    // Declarations dropped by error recovery so far.
+    size_t errorCount() const { return errors; }
+
+    // Deepest nesting of statements, expressions and prefix operators seen so far.
+    size_t maxDepth() const { return deepest; }
+
 private:
-    const std::vector<Token>& tokens;
+    // peek() and previous() are the only lookahead the grammar needs, so a streaming
+    // parser keeps just the last two tokens, indexed by the parity of current.
+    static constexpr size_t kLookahead = 2;
+
+    // A statement waiting for the statement nested in it.
+    struct StatementFrame {
+        enum Kind : uint8_t { DECLARATION, THEN_BRANCH, ELSE_BRANCH, WHILE_BODY, BLOCK };
+
+        Kind kind = DECLARATION;
+        int line = 0;
+        std::unique_ptr<Expr> condition;              // of an if or while
+        std::unique_ptr<Stmt> thenBranch;             // once parsed, while the else branch is
+        std::vector<std::unique_ptr<Stmt>> statements;  // of a block, so far
+    };
+
+    // An expression being parsed: everything from its first operand on that binds at least as
+    // tightly as minimum. use says what the frame below does with it once it is complete.
+    struct ExpressionFrame {
+        enum Use : uint8_t { RETURN, BINARY, ASSIGN, GROUP };
+
+        Precedence minimum = Precedence::ASSIGNMENT;
+        Use use = RETURN;
+        size_t prefixes = 0;  // prefixOperators from here on apply to this frame's first operand
+        std::unique_ptr<Expr> expr;
+        SymbolToken op;       // infix operator waiting for the frame above to finish its right operand
+    };
+
+    static constexpr size_t kReservedDepth = 64;
+
+    const std::vector<Token>* tokens = nullptr;
+    TokenSource* source = nullptr;
+    std::vector<Token> window;
     size_t current = 0;
+    size_t end = SIZE_MAX;
+    size_t errors = 0;
+    std::vector<StatementFrame> statementFrames;
+    std::vector<ExpressionFrame> expressionFrames;
+    std::vector<SymbolToken> prefixOperators;
+    size_t deepest = 0;
 
     bool isAtEnd() {
+        if (tokens && current >= end) return true;
         return peek().type == TokenType::END_OF_FILE;
     }
 
     const Token& peek() {
-        return tokens[current];
+        return tokens ? (*tokens)[current] : window[current % kLookahead];
     }
 
     const Token& previous() {
-        return tokens[current - 1];
+        return tokens ? (*tokens)[current - 1] : window[(current - 1) % kLookahead];
     }
 
+    // In streaming mode the returned reference only lasts until the next advance.
     const Token& advance() {
-        if (!isAtEnd()) current++;
+        if (!isAtEnd()) {
+            current++;
+            if (source) window[current % kLookahead] = source->next();
+        }
         return previous();
     }
 
@@ -47,14 +165,10 @@ private:
         return peek().type == type;
     }
 
-    bool match(const std::vector<TokenType>& types) {
-        for (const auto& type : types) {
-            if (check(type)) {
-                advance();
-                return true;
-            }
-        }
-        return false;
+    bool match(TokenType type) {
+        if (!check(type)) return false;
+        advance();
+        return true;
     }
 
     const Token& consume(TokenType type, const std::string& message) {
@@ -63,27 +177,154 @@ private:
         throw std::runtime_error("Parser error at line " + std::to_string(peek().line) + ": " + message);
     }
 
-    // Declarations
+    // Declarations and statements
+    // A statement nested in another one is parsed with a frame pushed on statementFrames instead
+    // of a recursive call, so the nesting depth is only bounded by memory. Declaration frames are
+    // where errors are recovered: an error anywhere inside one drops the frames above it, skips
+    // to the next statement and yields nullptr for it, as a try/catch around each recursive
+    // declaration() would.
     std::unique_ptr<Stmt> declaration() {
-        try {
-            if (match({TokenType::LET})) {
-                return variableDeclaration();
+        statementFrames.reserve(kReservedDepth);
+        size_t base = statementFrames.size();
+        pushStatementFrame(StatementFrame::DECLARATION, 0);
+
+        std::unique_ptr<Stmt> result;
+        bool descending = true;  // true: parse what the top frame waits for; false: hand it result
+        for (;;) {
+            try {
+                if (descending) {
+                    StatementFrame& frame = statementFrames.back();
+                    if (frame.kind == StatementFrame::BLOCK) {
+                        if (!check(TokenType::RIGHT_BRACE) && !isAtEnd()) {
+                            pushStatementFrame(StatementFrame::DECLARATION, 0);
+                            continue;
+                        }
+                        consume(TokenType::RIGHT_BRACE, "Expect '}' after block.");
+                        result = atLine(std::make_unique<BlockStmt>(std::move(frame.statements)), frame.line);
+                        statementFrames.pop_back();
+                        descending = false;
+                        continue;
+                    }
+
+                    int line = peek().line;
+                    if (frame.kind == StatementFrame::DECLARATION) {
+                        if (match(TokenType::LET)) {
+                            result = atLine(variableDeclaration(), line);
+                            descending = false;
+                            continue;
+                        }
+                        if (match(TokenType::PRINT)) {
+                            result = atLine(printStatement(), line);
+                            descending = false;
+                            continue;
+                        }
+                    }
+                    if (!statement(line)) {
+                        result = atLine(expressionStatement(), line);
+                        descending = false;
+                    }
+                    continue;
+                }
+
+                StatementFrame& frame = statementFrames.back();
+                switch (frame.kind) {
+                    case StatementFrame::DECLARATION:
+                        statementFrames.pop_back();
+                        if (statementFrames.size() == base) {
+                            return result;
+                        }
+                        // Only blocks hold declarations.
+                        if (result) {
+                            statementFrames.back().statements.push_back(std::move(result));
+                        }
+                        descending = true;
+                        break;
+                    case StatementFrame::THEN_BRANCH:
+                        frame.thenBranch = std::move(result);
+                        if (match(TokenType::ELSE)) {
+                            frame.kind = StatementFrame::ELSE_BRANCH;
+                            descending = true;
+                            break;
+                        }
+                        result = atLine(std::make_unique<IfStmt>(std::move(frame.condition), std::move(frame.thenBranch),
+                                                                 nullptr),
+                                        frame.line);
+                        statementFrames.pop_back();
+                        break;
+                    case StatementFrame::ELSE_BRANCH:
+                        result = atLine(std::make_unique<IfStmt>(std::move(frame.condition), std::move(frame.thenBranch),
+                                                                 std::move(result)),
+                                        frame.line);
+                        statementFrames.pop_back();
+                        break;
+                    case StatementFrame::WHILE_BODY:
+                        result = atLine(std::make_unique<WhileStmt>(std::move(frame.condition), std::move(result)),
+                                        frame.line);
+                        statementFrames.pop_back();
+                        break;
+                    case StatementFrame::BLOCK:
+                        break;  // blocks are handed their statements by the declaration frames above them
+                }
+            } catch (const std::runtime_error& error) {
+                TreeReleaser releaser;
+                releaser.add(std::move(result));
+                while (statementFrames.back().kind != StatementFrame::DECLARATION) {
+                    StatementFrame& frame = statementFrames.back();
+                    releaser.add(std::move(frame.condition));
+                    releaser.add(std::move(frame.thenBranch));
+                    releaser.add(frame.statements);
+                    statementFrames.pop_back();
+                }
+                releaser.run();
+                errors++;
+                synchronize();
+                descending = false;
             }
-            if (match({TokenType::PRINT})) {
-                return printStatement();
-            }
-            return statement();
-        } catch (const std::runtime_error& error) {
-            synchronize();
-            return nullptr;
         }
     }
 
+    // Starts an if, while or block statement by pushing its frame; false for any other statement.
+    bool statement(int line) {
+        if (match(TokenType::IF)) {
+            consume(TokenType::LEFT_PAREN, "Expect '(' after 'if'.");
+            auto condition = expression();
+            consume(TokenType::RIGHT_PAREN, "Expect ')' after if condition.");
+            pushStatementFrame(StatementFrame::THEN_BRANCH, line, std::move(condition));
+            return true;
+        }
+        if (match(TokenType::WHILE)) {
+            consume(TokenType::LEFT_PAREN, "Expect '(' after 'while'.");
+            auto condition = expression();
+            consume(TokenType::RIGHT_PAREN, "Expect ')' after condition.");
+            pushStatementFrame(StatementFrame::WHILE_BODY, line, std::move(condition));
+            return true;
+        }
+        if (match(TokenType::LEFT_BRACE)) {
+            pushStatementFrame(StatementFrame::BLOCK, line);
+            return true;
+        }
+        return false;
+    }
+
+    void pushStatementFrame(StatementFrame::Kind kind, int line, std::unique_ptr<Expr> condition = nullptr) {
+        StatementFrame frame;
+        frame.kind = kind;
+        frame.line = line;
+        frame.condition = std::move(condition);
+        statementFrames.push_back(std::move(frame));
+        trackDepth();
+    }
+
+    static std::unique_ptr<Stmt> atLine(std::unique_ptr<Stmt> stmt, int line) {
+        stmt->line = line;
+        return stmt;
+    }
+
     std::unique_ptr<Stmt> variableDeclaration() {
-        const Token& name = consume(TokenType::IDENTIFIER, "Expect variable name.");
+        SymbolToken name(consume(TokenType::IDENTIFIER, "Expect variable name."));
 
         std::unique_ptr<Expr> initializer;
-        if (match({TokenType::EQUAL})) {
+        if (match(TokenType::EQUAL)) {
             initializer = expression();
         }
 
@@ -91,63 +332,12 @@ private:
         return std::make_unique<VariableDeclarationStmt>(name, std::move(initializer));
     }
 
-    // Statements
-    std::unique_ptr<Stmt> statement() {
-        if (match({TokenType::IF})) {
-            return ifStatement();
-        }
-        if (match({TokenType::WHILE})) {
-            return whileStatement();
-        }
-        if (match({TokenType::LEFT_BRACE})) {
-            return std::make_unique<BlockStmt>(block());
-        }
-        return expressionStatement();
-    }
-
     std::unique_ptr<Stmt> printStatement() {
         auto value = expression();
         consume(TokenType::SEMICOLON, "Expect ';' after value.");
         return std::make_unique<PrintStmt>(std::move(value));
     }
 
-    std::unique_ptr<Stmt> ifStatement() {
-        consume(TokenType::LEFT_PAREN, "Expect '(' after 'if'.");
-        auto condition = expression();
-        consume(TokenType::RIGHT_PAREN, "Expect ')' after if condition.");
-
-        auto thenBranch = statement();
-        std::unique_ptr<Stmt> elseBranch;
-        if (match({TokenType::ELSE})) {
-            elseBranch = statement();
-        }
-
-        return std::make_unique<IfStmt>(std::move(condition), std::move(thenBranch), std::move(elseBranch));
-    }
-
-    std::unique_ptr<Stmt> whileStatement() {
-        consume(TokenType::LEFT_PAREN, "Expect '(' after 'while'.");
-        auto condition = expression();
-        consume(TokenType::RIGHT_PAREN, "Expect ')' after condition.");
-        auto body = statement();
-
-        return std::make_unique<WhileStmt>(std::move(condition), std::move(body));
-    }
-
-    std::vector<std::unique_ptr<Stmt>> block() {
-        std::vector<std::unique_ptr<Stmt>> statements;
-
-        while (!check(TokenType::RIGHT_BRACE) && !isAtEnd()) {
-            auto decl = declaration();
-            if (decl) {
-                statements.push_back(std::move(decl));
-            }
-        }
-
-        consume(TokenType::RIGHT_BRACE, "Expect '}' after block.");
-        return statements;
-    }
-
     std::unique_ptr<Stmt> expressionStatement() {
         auto expr = expression();
         consume(TokenType::SEMICOLON, "Expect ';' after expression.");
@@ -155,104 +345,123 @@ private:
     }
 
     // Expressions
+    // Operators are parsed by precedence climbing over PrecedenceTable: one loop handles every
+    // binary level, instead of one function per level for every operand. Each operand that is
+    // itself an expression (a right operand, an assigned value, a parenthesized group) gets a
+    // frame on expressionFrames, and prefix operators wait on prefixOperators until their
+    // operand is complete, so nothing here recurses either.
     std::unique_ptr<Expr> expression() {
-        return assignment();
-    }
-
-    std::unique_ptr<Expr> assignment() {
-        auto expr = equality();
-
-        if (match({TokenType::EQUAL})) {
-            const Token& equals = previous();
-            auto value = assignment();
-
-            if (auto varExpr = dynamic_cast<VariableExpr*>(expr.get())) {
-                Token name = varExpr->name;
-                return std::make_unique<AssignmentExpr>(name, std::move(value));
+        expressionFrames.reserve(kReservedDepth);
+        prefixOperators.reserve(kReservedDepth);
+        size_t base = expressionFrames.size();
+        size_t prefixBase = prefixOperators.size();
+        try {
+            pushExpressionFrame(Precedence::ASSIGNMENT, ExpressionFrame::RETURN);
+            for (;;) {
+                // The operand of the top frame: prefix operators, then a primary or a group.
+                while (match(TokenType::BANG) || match(TokenType::MINUS)) {
+                    prefixOperators.push_back(SymbolToken(previous()));
+                    trackDepth();
+                }
+                if (match(TokenType::LEFT_PAREN)) {
+                    pushExpressionFrame(Precedence::ASSIGNMENT, ExpressionFrame::GROUP);
+                    continue;
+                }
+                std::unique_ptr<Expr> operand = primary();
+
+                // Hand finished expressions down until a frame goes on with an infix operator.
+                for (;;) {
+                    ExpressionFrame& frame = expressionFrames.back();
+                    if (operand) {
+                        while (prefixOperators.size() > frame.prefixes) {
+                            operand = std::make_unique<UnaryExpr>(prefixOperators.back(), std::move(operand));
+                            prefixOperators.pop_back();
+                        }
+                        frame.expr = std::move(operand);
+                    }
+
+                    Precedence precedence = kPrecedenceTable[peek().type];
+                    if (precedence != Precedence::NONE && precedence >= frame.minimum) {
+                        frame.op = SymbolToken(advance());
+                        if (precedence == Precedence::ASSIGNMENT) {
+                            // Right-associative, and nothing binds more loosely.
+                            pushExpressionFrame(Precedence::ASSIGNMENT, ExpressionFrame::ASSIGN);
+                        } else {
+                            // Left-associative: the right operand only takes operators that bind tighter.
+                            pushExpressionFrame(static_cast<Precedence>(static_cast<uint8_t>(precedence) + 1),
+                                                ExpressionFrame::BINARY);
+                        }
+                        break;
+                    }
+
+                    std::unique_ptr<Expr> expr = std::move(frame.expr);
+                    ExpressionFrame::Use use = frame.use;
+                    expressionFrames.pop_back();
+                    if (use == ExpressionFrame::RETURN) {
+                        return expr;
+                    }
+                    if (use == ExpressionFrame::GROUP) {
+                        consume(TokenType::RIGHT_PAREN, "Expect ')' after expression.");
+                        operand = std::move(expr);
+                        continue;
+                    }
+
+                    ExpressionFrame& parent = expressionFrames.back();
+                    if (use == ExpressionFrame::BINARY) {
+                        parent.expr = std::make_unique<BinaryExpr>(std::move(parent.expr), parent.op, std::move(expr));
+                    } else if (auto varExpr = dynamic_cast<VariableExpr*>(parent.expr.get())) {
+                        SymbolToken name = varExpr->name;
+                        releaseExpression(std::move(parent.expr));
+                        parent.expr = std::make_unique<AssignmentExpr>(name, std::move(expr));
+                    } else {
+                        releaseExpression(std::move(expr));
+                        throw std::runtime_error("Invalid assignment target at line " + std::to_string(parent.op.line));
+                    }
+                }
             }
-
-            throw std::runtime_error("Invalid assignment target at line " + std::to_string(equals.line));
-        }
-
-        return expr;
-    }
-
-    std::unique_ptr<Expr> equality() {
-        auto expr = comparison();
-
-        while (match({TokenType::BANG_EQUAL, TokenType::EQUAL_EQUAL})) {
-            const Token& op = previous();
-            auto right = comparison();
-            expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
-        }
-
-        return expr;
-    }
-
-    std::unique_ptr<Expr> comparison() {
-        auto expr = term();
-
-        while (match({TokenType::GREATER, TokenType::GREATER_EQUAL, TokenType::LESS, TokenType::LESS_EQUAL})) {
-            const Token& op = previous();
-            auto right = term();
-            expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
+        } catch (...) {
+            TreeReleaser releaser;
+            while (expressionFrames.size() > base) {
+                releaser.add(std::move(expressionFrames.back().expr));
+                expressionFrames.pop_back();
+            }
+            releaser.run();
+            prefixOperators.resize(prefixBase);
+            throw;
         }
-
-        return expr;
     }
 
-    std::unique_ptr<Expr> term() {
-        auto expr = factor();
-
-        while (match({TokenType::MINUS, TokenType::PLUS})) {
-            const Token& op = previous();
-            auto right = factor();
-            expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
-        }
-
-        return expr;
+    void pushExpressionFrame(Precedence minimum, ExpressionFrame::Use use) {
+        ExpressionFrame frame;
+        frame.minimum = minimum;
+        frame.use = use;
+        frame.prefixes = prefixOperators.size();
+        expressionFrames.push_back(std::move(frame));
+        trackDepth();
     }
 
-    std::unique_ptr<Expr> factor() {
-        auto expr = unary();
-
-        while (match({TokenType::SLASH, TokenType::STAR})) {
-            const Token& op = previous();
-            auto right = unary();
-            expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
-        }
-
-        return expr;
+    static void releaseExpression(std::unique_ptr<Expr> expr) {
+        TreeReleaser releaser;
+        releaser.add(std::move(expr));
+        releaser.run();
     }
 
-    std::unique_ptr<Expr> unary() {
-        if (match({TokenType::BANG, TokenType::MINUS})) {
-            const Token& op = previous();
-            auto right = unary();
-            return std::make_unique<UnaryExpr>(op, std::move(right));
-        }
-
-        return primary();
+    void trackDepth() {
+        deepest = std::max(deepest, statementFrames.size() + expressionFrames.size() + prefixOperators.size());
     }
 
     std::unique_ptr<Expr> primary() {
-        if (match({TokenType::FALSE})) return std::make_unique<LiteralExpr>(0.0);
-        if (match({TokenType::TRUE})) return std::make_unique<LiteralExpr>(1.0);
-        if (match({TokenType::NIL})) return std::make_unique<LiteralExpr>(0.0);
+        if (match(TokenType::FALSE)) return std::make_unique<LiteralExpr>(0.0);
+        if (match(TokenType::TRUE)) return std::make_unique<LiteralExpr>(1.0);
+        if (match(TokenType::NIL)) return std::make_unique<LiteralExpr>(0.0);
 
-        if (match({TokenType::NUMBER})) {
+        if (match(TokenType::NUMBER)) {
             double value = std::stod(previous().lexeme);
             return std::make_unique<LiteralExpr>(value);
         }
 
-        if (match({TokenType::IDENTIFIER})) {
-            return std::make_unique<VariableExpr>(previous());
-        }
-
-        if (match({TokenType::LEFT_PAREN})) {
-            auto expr = expression();
-            consume(TokenType::RIGHT_PAREN, "Expect ')' after expression.");
-            return expr;
+        if (match(TokenType::IDENTIFIER)) {
+            return std::make_unique<VariableExpr>(SymbolToken(previous()));
         }
 
         throw std::runtime_error("Expect expression at line " + std::to_string(peek().line));
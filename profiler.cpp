@@ -0,0 +1,183 @@
+#include "abstract_syntax_tree.cpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+
+// 4a. Profiling (Profiler)
+// Records how often each statement and each while-loop iteration runs and how long it takes,
+// per call path. report() folds the paths into one row per source line; writeCollapsed()
+// keeps them apart for flame graphs. Build with -DPROFILE_INTERPRETER to enable it; otherwise
+// the PROFILE_SCOPE hooks in the Interpreter expand to nothing and cost nothing.
+
+#ifndef PROFILER
+#define PROFILER
+
+#ifdef PROFILE_INTERPRETER
+#define PROFILE_SCOPE(profiler, stmt, iteration) Profiler::Scope profileScope(profiler, stmt, iteration)
+#else
+#define PROFILE_SCOPE(profiler, stmt, iteration) ((void)0)
+#endif
+
+class Profiler {
+public:
+    // Times one statement (or one loop iteration) for as long as it is alive.
+    class Scope {
+    public:
+        Scope(Profiler& profiler, const Stmt& stmt, bool iteration) : profiler(profiler) {
+            profiler.enter(stmt, iteration);
+        }
+        ~Scope() { profiler.exit(); }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Profiler& profiler;
+    };
+
+    Profiler() {
+        nodes.push_back({-1, nullptr, false, 0, 0, 0});
+        stack.push_back({0, Clock::now()});
+    }
+
+    // Prints the hottest source lines, most self time first. Every call path through a line is
+    // folded into one row: count is how often statements on the line ran, iterations how often
+    // loops on it went round, and self time excludes the statements nested inside.
+    void report(std::ostream& out, size_t limit = 20) const {
+        struct Line {
+            int line;
+            uint64_t count;
+            uint64_t iterations;
+            uint64_t selfNs;
+        };
+        std::vector<Line> lines;
+        std::unordered_map<int, size_t> lineIndex;
+        for (size_t i = 1; i < nodes.size(); ++i) {
+            const Node& node = nodes[i];
+            auto inserted = lineIndex.emplace(node.stmt->line, lines.size());
+            if (inserted.second) {
+                lines.push_back({node.stmt->line, 0, 0, 0});
+            }
+            Line& entry = lines[inserted.first->second];
+            (node.iteration ? entry.iterations : entry.count) += node.count;
+            entry.selfNs += node.totalNs - node.childNs;
+        }
+        std::sort(lines.begin(), lines.end(), [](const Line& a, const Line& b) {
+            return a.selfNs != b.selfNs ? a.selfNs > b.selfNs : a.line < b.line;
+        });
+
+        out << "Profile (hottest first)\n"
+            << std::left << std::setw(8) << "line" << std::right << std::setw(12) << "count" << std::setw(12)
+            << "iterations" << std::setw(14) << "self ms" << "\n";
+        for (size_t i = 0; i < lines.size() && i < limit; ++i) {
+            const Line& entry = lines[i];
+            out << std::left << std::setw(8) << entry.line << std::right << std::setw(12) << entry.count
+                << std::setw(12) << entry.iterations << std::fixed << std::setprecision(3) << std::setw(14)
+                << entry.selfNs / 1e6 << "\n";
+        }
+    }
+
+    // Writes one "frame;frame;frame self-nanoseconds" line per call path, the collapsed
+    // format flamegraph.pl and speedscope read.
+    bool writeCollapsed(const std::string& path) const {
+        std::ofstream out(path);
+        for (size_t i = 1; i < nodes.size(); ++i) {
+            uint64_t selfNs = nodes[i].totalNs - nodes[i].childNs;
+            if (selfNs == 0) continue;
+
+            std::vector<size_t> frames;
+            for (int node = static_cast<int>(i); node > 0; node = nodes[node].parent) {
+                frames.push_back(node);
+            }
+            for (size_t f = frames.size(); f > 0; --f) {
+                const Node& frame = nodes[frames[f - 1]];
+                out << kindOf(frame) << ":" << frame.stmt->line << (f > 1 ? ";" : " ");
+            }
+            out << selfNs << "\n";
+        }
+        return static_cast<bool>(out);
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // One node per distinct call path, so the same statement under different loops stays separate.
+    struct Node {
+        int parent;
+        const Stmt* stmt;
+        bool iteration;
+        uint64_t count;
+        uint64_t totalNs;
+        uint64_t childNs;
+    };
+
+    struct Frame {
+        int node;
+        Clock::time_point start;
+    };
+
+    struct Key {
+        int parent;
+        const Stmt* stmt;
+        bool iteration;
+
+        bool operator==(const Key& other) const {
+            return parent == other.parent && stmt == other.stmt && iteration == other.iteration;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            return std::hash<const void*>()(key.stmt) ^ (static_cast<size_t>(key.parent) << 1) ^ key.iteration;
+        }
+    };
+
+    std::vector<Node> nodes;
+    std::vector<Frame> stack;
+    std::unordered_map<Key, int, KeyHash> children;
+
+    void enter(const Stmt& stmt, bool iteration) {
+        Key key{stack.back().node, &stmt, iteration};
+        auto it = children.find(key);
+        int node;
+        if (it == children.end()) {
+            node = static_cast<int>(nodes.size());
+            nodes.push_back({key.parent, &stmt, iteration, 0, 0, 0});
+            children.emplace(key, node);
+        } else {
+            node = it->second;
+        }
+        nodes[node].count++;
+        stack.push_back({node, Clock::now()});
+    }
+
+    void exit() {
+        Frame frame = stack.back();
+        stack.pop_back();
+        uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - frame.start).count();
+        nodes[frame.node].totalNs += elapsed;
+        nodes[stack.back().node].childNs += elapsed;
+    }
+
+    // Names a statement for reports; only called when printing.
+    class KindNamer : public StmtVisitor {
+    public:
+        const char* kind = "statement";
+
+        void visitExpressionStmt(ExpressionStmt&) override { kind = "expression"; }
+        void visitVariableDeclarationStmt(VariableDeclarationStmt&) override { kind = "let"; }
+        void visitBlockStmt(BlockStmt&) override { kind = "block"; }
+        void visitIfStmt(IfStmt&) override { kind = "if"; }
+        void visitWhileStmt(WhileStmt&) override { kind = "while"; }
+        void visitPrintStmt(PrintStmt&) override { kind = "print"; }
+    };
+
+    static const char* kindOf(const Node& node) {
+        if (node.iteration) return "iteration";
+        KindNamer namer;
+        const_cast<Stmt*>(node.stmt)->accept(namer);
+        return namer.kind;
+    }
+};
+#endif
@@ -0,0 +1,168 @@
+#include "enviroment_interpretation.cpp"
+#include <chrono>
+#include <fstream>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+// 14. Interactive Session (Repl)
+// Reads programs a line at a time and runs them against one long-lived Interpreter and Resolver,
+// so variables declared by earlier inputs stay visible to later ones. Only the new input is
+// lexed, parsed, optimized and resolved: earlier inputs are never looked at again, so the cost of
+// an input depends on its own size, not on how much the session has already defined. An input
+// whose braces or parentheses are still open continues on the next line. When a runtime error
+// stops an input, the variables it declared before the error stay defined and the later ones do not.
+//   :time  toggles a per-input report of how long each phase took
+//   :mem   reports what the session holds: symbols, global slots, AST bytes and process memory
+//   :quit  ends the session (so does end of input)
+
+#ifndef REPL
+#define REPL
+
+struct ReplStats {
+    size_t inputs = 0;
+    size_t failedInputs = 0;   // parse or resolve errors; nothing was run
+    size_t astBytes = 0;       // allocated by every input's tree, all released after it ran
+    size_t largestAstBytes = 0;
+};
+
+class Repl {
+public:
+    Repl(std::istream& in = std::cin, std::ostream& out = std::cout, std::ostream& err = std::cerr)
+        : in(in), out(out), err(err), interpreter(out, FlushPolicy::LINE, err), resolver(err) {}
+
+    void run() {
+        std::string input;
+        std::string line;
+        int depth = 0;
+        out << kPrompt << std::flush;
+        while (std::getline(in, line)) {
+            if (input.empty() && !line.empty() && line[0] == ':') {
+                if (!command(line)) return;
+                out << kPrompt << std::flush;
+                continue;
+            }
+
+            input += line;
+            input += '\n';
+            depth += nesting(line);
+            if (depth > 0) {
+                out << kContinuation << std::flush;
+                continue;
+            }
+            evaluate(input);
+            input.clear();
+            depth = 0;
+            out << kPrompt << std::flush;
+        }
+        if (!input.empty()) evaluate(input);
+    }
+
+    // Lexes, parses, resolves and runs one input against the session's state.
+    void evaluate(const std::string& source) {
+        using Clock = std::chrono::steady_clock;
+        auto start = Clock::now();
+        stats.inputs++;
+
+        // Each input gets its own small arena; nothing refers to its tree once it has run.
+        AstArena arena(4 * 1024);
+        Lexer lexer(source);
+        std::vector<Token> tokens = lexer.scanTokens();
+        Parser parser(tokens);
+        std::vector<std::unique_ptr<Stmt>> statements = parser.parse(arena);
+        stats.astBytes += arena.bytesAllocated();
+        stats.largestAstBytes = std::max(stats.largestAstBytes, arena.bytesAllocated());
+        auto parsed = Clock::now();
+
+        // An input with a parse error is rejected whole, before the Resolver declares any of it.
+        bool accepted = parser.errorCount() == 0;
+        if (!accepted) {
+            err << "Parse error: skipped " << parser.errorCount() << " declaration(s)\n";
+        } else {
+            Optimizer optimizer(1);
+            optimizer.optimize(statements);
+            accepted = resolver.resolve(statements);
+        }
+        auto checked = Clock::now();
+
+        if (!accepted) {
+            stats.failedInputs++;
+        } else {
+            interpreter.reserveGlobals(resolver.globalSlotCount());
+            size_t completed = interpreter.interpret(statements);
+            if (completed < statements.size()) {
+                // A runtime error stopped the input: the `let`s it never reached declare nothing.
+                resolver.forgetUnreachedGlobals(statements, completed);
+            }
+        }
+        auto finished = Clock::now();
+
+        if (showTimes) {
+            err << "[parse " << microseconds(start, parsed) << " us, resolve " << microseconds(parsed, checked)
+                << " us, run " << microseconds(checked, finished) << " us]\n";
+        }
+    }
+
+    const ReplStats& sessionStats() const { return stats; }
+
+private:
+    static constexpr const char* kPrompt = "> ";
+    static constexpr const char* kContinuation = ". ";
+
+    std::istream& in;
+    std::ostream& out;
+    std::ostream& err;
+    Interpreter interpreter;
+    Resolver resolver;
+    ReplStats stats;
+    bool showTimes = false;
+
+    // Returns false when the session should end.
+    bool command(const std::string& line) {
+        if (line == ":quit") return false;
+        if (line == ":time") {
+            showTimes = !showTimes;
+            err << "Timing " << (showTimes ? "on" : "off") << "\n";
+        } else if (line == ":mem") {
+            err << "Session: " << stats.inputs << " inputs (" << stats.failedInputs << " rejected), "
+                << SymbolTable::global().size() << " symbols, " << resolver.globalSlotCount() << " globals ("
+                << resolver.globalSlotCount() * sizeof(double) << " bytes), AST " << stats.astBytes
+                << " bytes allocated in total, largest input " << stats.largestAstBytes << " bytes";
+            size_t resident = residentBytes();
+            if (resident > 0) err << ", resident " << resident / 1024 << " KiB";
+            err << "\n";
+        } else {
+            err << "Unknown command '" << line << "' (try :time, :mem or :quit)\n";
+        }
+        return true;
+    }
+
+    // How many more braces and parentheses line opens than it closes, ignoring comments.
+    static int nesting(const std::string& line) {
+        int depth = 0;
+        for (size_t i = 0; i < line.size(); ++i) {
+            char c = line[i];
+            if (c == '/' && i + 1 < line.size() && line[i + 1] == '/') break;
+            if (c == '{' || c == '(') depth++;
+            if (c == '}' || c == ')') depth--;
+        }
+        return depth;
+    }
+
+    static long long microseconds(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(to - from).count();
+    }
+
+    // Resident set size of the process, or 0 where it cannot be read.
+    static size_t residentBytes() {
+#ifdef __linux__
+        std::ifstream statm("/proc/self/statm");
+        size_t pages = 0;
+        size_t resident = 0;
+        if (statm >> pages >> resident) return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+        return 0;
+    }
+};
+#endif
@@ -0,0 +1,227 @@
+#include "optimizer.cpp"
+#include <unordered_set>
+
+// 3b. Static Resolution (Resolver)
+// The resolver runs after parsing and binds every variable use to the scope that declares it.
+// Each VariableExpr, AssignmentExpr and VariableDeclarationStmt gets a (depth, slot) pair,
+// so the interpreter can index frames directly instead of hashing names at runtime.
+// The tree is walked with an explicit work list rather than accept(), so that programs nested
+// deeper than the native stack allows are resolved too.
+
+#ifndef RESOLVER
+#define RESOLVER
+
+class Resolver {
+public:
+    explicit Resolver(std::ostream& err = std::cerr) : err(err) {}
+
+    // Resolves the whole program. Reports every undefined variable and returns false if any were found.
+    // A failed call leaves the global scope as it was, so its declarations stay undefined.
+    bool resolve(const std::vector<std::unique_ptr<Stmt>>& statements) {
+        errors.clear();
+        newGlobals.clear();
+        if (scopes.empty()) {
+            scopes.emplace_back();
+        }
+
+        work.reserve(kReservedWork);
+        for (auto it = statements.rbegin(); it != statements.rend(); ++it) {
+            push(it->get());
+        }
+        run();
+
+        for (const auto& error : errors) {
+            err << "Resolve error: " << error << "\n";
+        }
+        if (!errors.empty()) {
+            forgetGlobals(newGlobals.size());
+        }
+        return errors.empty();
+    }
+
+    // Reports undefined variables exactly like resolve() but leaves the scopes as they were. Run
+    // before passes that may delete code (dead branches at -O2), so that whether a program is
+    // accepted, and the order its errors come in, does not depend on the optimization level.
+    bool check(const std::vector<std::unique_ptr<Stmt>>& statements) {
+        bool valid = resolve(statements);
+        forgetGlobals(newGlobals.size());
+        return valid;
+    }
+
+    // For a run of the statements the last resolve() accepted that stopped after the first `ran`
+    // of them: the globals only later statements declare are undefined again.
+    void forgetUnreachedGlobals(const std::vector<std::unique_ptr<Stmt>>& statements, size_t ran) {
+        std::unordered_set<uint32_t> declared;
+        for (size_t i = 0; i < ran && i < statements.size(); ++i) {
+            if (statements[i]->kind == StmtKind::VARIABLE_DECLARATION) {
+                declared.insert(static_cast<VariableDeclarationStmt&>(*statements[i]).name.symbol);
+            }
+        }
+        // New globals are numbered in the order they were declared, so the ones that ran come first.
+        size_t kept = 0;
+        while (kept < newGlobals.size() && declared.count(newGlobals[kept])) kept++;
+        forgetGlobals(newGlobals.size() - kept);
+    }
+
+    // Number of slots the global scope needs. Resolving more statements later
+    // (the global scope is kept between calls) only ever grows it.
+    size_t globalSlotCount() const {
+        return scopes.empty() ? 0 : scopes.front().slots.size();
+    }
+
+private:
+    struct Scope {
+        std::unordered_map<uint32_t, int> slots;  // symbol id -> slot
+    };
+
+    // One step of the walk. Nodes are visited when popped; the other steps finish a node
+    // once everything pushed after them is done.
+    struct Work {
+        enum Step : uint8_t { EXPR, STMT, ASSIGN, DECLARE, CLOSE_BLOCK };
+
+        Step step;
+        void* node;
+    };
+
+    static constexpr size_t kReservedWork = 64;
+
+    std::vector<Scope> scopes;
+    // symbol id -> the scopes that declare it, innermost last, so a lookup does not walk
+    // every enclosing scope
+    std::unordered_map<uint32_t, std::vector<uint32_t>> bindings;
+    std::vector<Work> work;
+    std::vector<std::string> errors;
+    std::vector<uint32_t> newGlobals;  // declared in the global scope by the current call, in order
+    std::ostream& err;
+
+    // Drops the newest count globals, so the remaining ones stay numbered 0..n-1.
+    void forgetGlobals(size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            uint32_t symbol = newGlobals.back();
+            newGlobals.pop_back();
+            scopes.front().slots.erase(symbol);
+            bindings[symbol].pop_back();
+        }
+    }
+
+    int declare(const SymbolToken& name) {
+        Scope& scope = scopes.back();
+        auto it = scope.slots.find(name.symbol);
+        if (it != scope.slots.end()) {
+            // Redeclaration in the same scope overwrites, like Environment::define.
+            return it->second;
+        }
+        int slot = static_cast<int>(scope.slots.size());
+        scope.slots.emplace(name.symbol, slot);
+        bindings[name.symbol].push_back(static_cast<uint32_t>(scopes.size() - 1));
+        if (scopes.size() == 1) newGlobals.push_back(name.symbol);
+        return slot;
+    }
+
+    bool lookUp(const SymbolToken& name, int& depth, int& slot) {
+        auto it = bindings.find(name.symbol);
+        if (it != bindings.end() && !it->second.empty()) {
+            uint32_t scope = it->second.back();
+            depth = static_cast<int>(scopes.size() - 1 - scope);
+            slot = scopes[scope].slots.at(name.symbol);
+            return true;
+        }
+        errors.push_back("Undefined variable '" + std::string(name.lexeme) + "' at line " + std::to_string(name.line));
+        return false;
+    }
+
+    void push(Expr* expr) { work.push_back({Work::EXPR, expr}); }
+    void push(Stmt* stmt) { work.push_back({Work::STMT, stmt}); }
+
+    // Children are pushed in reverse, so they are resolved in source order.
+    void run() {
+        while (!work.empty()) {
+            Work item = work.back();
+            work.pop_back();
+            switch (item.step) {
+                case Work::EXPR: visit(*static_cast<Expr*>(item.node)); break;
+                case Work::STMT: visit(*static_cast<Stmt*>(item.node)); break;
+                case Work::ASSIGN: {
+                    auto& expr = *static_cast<AssignmentExpr*>(item.node);
+                    lookUp(expr.name, expr.depth, expr.slot);
+                    break;
+                }
+                case Work::DECLARE: {
+                    auto& stmt = *static_cast<VariableDeclarationStmt*>(item.node);
+                    stmt.depth = 0;
+                    stmt.slot = declare(stmt.name);
+                    break;
+                }
+                case Work::CLOSE_BLOCK: {
+                    auto& stmt = *static_cast<BlockStmt*>(item.node);
+                    stmt.slotCount = static_cast<int>(scopes.back().slots.size());
+                    for (const auto& entry : scopes.back().slots) bindings[entry.first].pop_back();
+                    scopes.pop_back();
+                    break;
+                }
+            }
+        }
+    }
+
+    void visit(Expr& expr) {
+        switch (expr.kind) {
+            case ExprKind::LITERAL:
+                break;
+            case ExprKind::VARIABLE: {
+                auto& variable = static_cast<VariableExpr&>(expr);
+                lookUp(variable.name, variable.depth, variable.slot);
+                break;
+            }
+            case ExprKind::UNARY:
+                push(static_cast<UnaryExpr&>(expr).right.get());
+                break;
+            case ExprKind::BINARY:
+                push(static_cast<BinaryExpr&>(expr).right.get());
+                push(static_cast<BinaryExpr&>(expr).left.get());
+                break;
+            case ExprKind::ASSIGNMENT:
+                work.push_back({Work::ASSIGN, &expr});
+                push(static_cast<AssignmentExpr&>(expr).value.get());
+                break;
+        }
+    }
+
+    void visit(Stmt& stmt) {
+        switch (stmt.kind) {
+            case StmtKind::EXPRESSION:
+                push(static_cast<ExpressionStmt&>(stmt).expression.get());
+                break;
+            case StmtKind::VARIABLE_DECLARATION: {
+                // The initializer still sees any outer variable of the same name.
+                auto& declaration = static_cast<VariableDeclarationStmt&>(stmt);
+                work.push_back({Work::DECLARE, &stmt});
+                if (declaration.initializer) push(declaration.initializer.get());
+                break;
+            }
+            case StmtKind::BLOCK: {
+                auto& block = static_cast<BlockStmt&>(stmt);
+                scopes.emplace_back();
+                work.push_back({Work::CLOSE_BLOCK, &stmt});
+                for (auto it = block.statements.rbegin(); it != block.statements.rend(); ++it) {
+                    push(it->get());
+                }
+                break;
+            }
+            case StmtKind::IF: {
+                auto& ifStmt = static_cast<IfStmt&>(stmt);
+                if (ifStmt.elseBranch) push(ifStmt.elseBranch.get());
+                push(ifStmt.thenBranch.get());
+                push(ifStmt.condition.get());
+                break;
+            }
+            case StmtKind::WHILE:
+                push(static_cast<WhileStmt&>(stmt).body.get());
+                push(static_cast<WhileStmt&>(stmt).condition.get());
+                break;
+            case StmtKind::PRINT:
+                push(static_cast<PrintStmt&>(stmt).expression.get());
+                break;
+        }
+    }
+};
+#endif
@@ -0,0 +1,471 @@
+#include "batch_runner.cpp"
+#include <chrono>
+
+// 15. Resumable Execution (WorkStackEvaluator, ResumableScript, ScriptMultiplexer)
+// Runs a resolved program a bounded number of steps at a time. Instead of recursing through the
+// tree, WorkStackEvaluator keeps an explicit work stack: every entry is a node plus how far its
+// evaluation has got, and one step advances the top entry by one stage. Everything a running
+// program needs (work stack, value stack, frame slots, output) lives in the ResumableScript, so
+// run() can return after any step and be called again later to carry on exactly where it stopped.
+// ScriptMultiplexer uses that to run many scripts round-robin on one thread, a slice of steps each,
+// and to stop scripts that exceed a step limit.
+
+#ifndef RESUMABLE_INTERPRETER
+#define RESUMABLE_INTERPRETER
+
+enum class ScriptStatus {
+    SUSPENDED,  // budget used up; run() continues it
+    FINISHED,
+    FAILED,     // stopped by a runtime error
+    KILLED      // stopped from outside
+};
+
+// Evaluates a resolved program on explicit stacks instead of the native one. Every work entry is
+// a node plus how far its evaluation has got, and one step advances the top entry by one stage;
+// nodes are told apart by their kind tag. Statements of the top level and of a block are pushed one
+// at a time, so the work stack only ever holds the chain of nodes being evaluated and its size is
+// the nesting depth reached. Frames live in one slot array, innermost last.
+class WorkStackEvaluator {
+public:
+    WorkStackEvaluator(const std::vector<std::unique_ptr<Stmt>>& statements, size_t globalSlots, OutputBuffer& output)
+        : program(&statements), output(&output), slots(globalSlots, 0.0), top(globalSlots) {
+        scopeBases.push_back(0);
+        work.reserve(kReservedDepth);
+        values.reserve(kReservedDepth);
+    }
+
+    // Runs at most budget steps and returns true once the whole program has run. A runtime error
+    // drops the rest of the program and is thrown on to the caller.
+    bool run(size_t budget) {
+        try {
+            for (; budget > 0; --budget) {
+                if (work.empty()) {
+                    if (next == program->size()) return true;
+                    push(*(*program)[next++]);
+                }
+                step();
+            }
+        } catch (const std::runtime_error&) {
+            stop();
+            throw;
+        }
+        return work.empty() && next == program->size();
+    }
+
+    // Drops whatever is left of the program.
+    void stop() {
+        work.clear();
+        values.clear();
+        next = program->size();
+    }
+
+    size_t steps() const { return stepCount; }
+
+    // The deepest chain of nested nodes that was being evaluated at once.
+    size_t maxDepth() const { return deepest; }
+
+    static double applyUnary(const SymbolToken& op, double right) {
+        switch (op.type) {
+            case TokenType::MINUS: return -right;
+            case TokenType::BANG: return right == 0.0 ? 1.0 : 0.0;
+            default: throw std::runtime_error("Unknown unary operator at line " + std::to_string(op.line));
+        }
+    }
+
+    static double applyBinary(const SymbolToken& op, double left, double right) {
+        switch (op.type) {
+            case TokenType::PLUS: return left + right;
+            case TokenType::MINUS: return left - right;
+            case TokenType::STAR: return left * right;
+            case TokenType::SLASH:
+                if (right == 0) {
+                    throw std::runtime_error("Division by zero at line " + std::to_string(op.line));
+                }
+                return left / right;
+            case TokenType::GREATER: return left > right ? 1.0 : 0.0;
+            case TokenType::GREATER_EQUAL: return left >= right ? 1.0 : 0.0;
+            case TokenType::LESS: return left < right ? 1.0 : 0.0;
+            case TokenType::LESS_EQUAL: return left <= right ? 1.0 : 0.0;
+            case TokenType::EQUAL_EQUAL: return left == right ? 1.0 : 0.0;
+            case TokenType::BANG_EQUAL: return left != right ? 1.0 : 0.0;
+            default: throw std::runtime_error("Unknown binary operator at line " + std::to_string(op.line));
+        }
+    }
+
+private:
+    static constexpr size_t kReservedDepth = 256;
+
+    // A node and the stage its evaluation has reached. Exactly one of stmt and expr is set.
+    struct WorkItem {
+        const Stmt* stmt;
+        const Expr* expr;
+        uint32_t stage;
+    };
+
+    const std::vector<std::unique_ptr<Stmt>>* program;
+    OutputBuffer* output;
+    size_t next = 0;                 // the next top-level statement
+    std::vector<WorkItem> work;
+    std::vector<double> values;
+    std::vector<double> slots;       // every scope's slots, innermost last
+    std::vector<size_t> scopeBases;  // first slot of every enclosing scope
+    size_t top;
+    size_t stepCount = 0;
+    size_t deepest = 0;
+
+    void step() {
+        stepCount++;
+        const WorkItem& item = work.back();
+        if (item.stmt) {
+            const Stmt& stmt = *item.stmt;
+            switch (stmt.kind) {
+                case StmtKind::EXPRESSION: expressionStmt(static_cast<const ExpressionStmt&>(stmt)); break;
+                case StmtKind::VARIABLE_DECLARATION:
+                    declaration(static_cast<const VariableDeclarationStmt&>(stmt));
+                    break;
+                case StmtKind::BLOCK: block(static_cast<const BlockStmt&>(stmt)); break;
+                case StmtKind::IF: ifStmt(static_cast<const IfStmt&>(stmt)); break;
+                case StmtKind::WHILE: whileStmt(static_cast<const WhileStmt&>(stmt)); break;
+                case StmtKind::PRINT: print(static_cast<const PrintStmt&>(stmt)); break;
+            }
+            return;
+        }
+        const Expr& expr = *item.expr;
+        switch (expr.kind) {
+            case ExprKind::LITERAL:
+                values.push_back(static_cast<const LiteralExpr&>(expr).value);
+                finish();
+                break;
+            case ExprKind::VARIABLE: {
+                const auto& variable = static_cast<const VariableExpr&>(expr);
+                values.push_back(slot(variable.depth, variable.slot, variable.name));
+                finish();
+                break;
+            }
+            case ExprKind::UNARY: unary(static_cast<const UnaryExpr&>(expr)); break;
+            case ExprKind::BINARY: binary(static_cast<const BinaryExpr&>(expr)); break;
+            case ExprKind::ASSIGNMENT: assignment(static_cast<const AssignmentExpr&>(expr)); break;
+        }
+    }
+
+    // The handlers below see the top work item; they either move it to its next stage and push
+    // the child it is waiting for, or finish it and pop it.
+    uint32_t stage() const { return work.back().stage; }
+    void advance() { work.back().stage++; }
+    void finish() { work.pop_back(); }
+
+    void push(const Expr& expr) {
+        work.push_back({nullptr, &expr, 0});
+        deepest = std::max(deepest, work.size());
+    }
+
+    void push(const Stmt& stmt) {
+        work.push_back({&stmt, nullptr, 0});
+        deepest = std::max(deepest, work.size());
+    }
+
+    double pop() {
+        double value = values.back();
+        values.pop_back();
+        return value;
+    }
+
+    double& slot(int depth, int index, const SymbolToken& name) {
+        if (index < 0 || depth < 0 || static_cast<size_t>(depth) >= scopeBases.size()) {
+            throw std::runtime_error("Variable '" + std::string(name.lexeme) + "' at line " +
+                                     std::to_string(name.line) + " is not resolved");
+        }
+        return slots[scopeBases[scopeBases.size() - 1 - depth] + index];
+    }
+
+    void unary(const UnaryExpr& expr) {
+        if (stage() == 0) {
+            advance();
+            push(*expr.right);
+            return;
+        }
+        values.push_back(applyUnary(expr.op, pop()));
+        finish();
+    }
+
+    void binary(const BinaryExpr& expr) {
+        switch (stage()) {
+            case 0:
+                advance();
+                push(*expr.left);
+                return;
+            case 1:
+                advance();
+                push(*expr.right);
+                return;
+            default:
+                break;
+        }
+        double right = pop();
+        double left = pop();
+        values.push_back(applyBinary(expr.op, left, right));
+        finish();
+    }
+
+    void assignment(const AssignmentExpr& expr) {
+        if (stage() == 0) {
+            advance();
+            push(*expr.value);
+            return;
+        }
+        // The value stays on the stack as the value of the assignment.
+        slot(expr.depth, expr.slot, expr.name) = values.back();
+        finish();
+    }
+
+    void expressionStmt(const ExpressionStmt& stmt) {
+        if (stage() == 0) {
+            advance();
+            push(*stmt.expression);
+            return;
+        }
+        pop();
+        finish();
+    }
+
+    void declaration(const VariableDeclarationStmt& stmt) {
+        if (stage() == 0 && stmt.initializer) {
+            advance();
+            push(*stmt.initializer);
+            return;
+        }
+        double value = stmt.initializer ? pop() : 0.0;
+        slot(0, stmt.slot, stmt.name) = value;
+        finish();
+    }
+
+    void block(const BlockStmt& stmt) {
+        // Stage 0 opens the scope, stage i runs statement i - 1, the last stage closes the scope.
+        uint32_t index = stage();
+        if (index == 0) {
+            if (stmt.slotCount < 0) {
+                throw std::runtime_error("Block at line " + std::to_string(stmt.line) + " is not resolved");
+            }
+            scopeBases.push_back(top);
+            top += stmt.slotCount;
+            if (slots.size() < top) slots.resize(top);
+            std::fill(slots.begin() + scopeBases.back(), slots.begin() + top, 0.0);
+        }
+        if (index < stmt.statements.size()) {
+            advance();
+            push(*stmt.statements[index]);
+            return;
+        }
+        top = scopeBases.back();
+        scopeBases.pop_back();
+        finish();
+    }
+
+    void ifStmt(const IfStmt& stmt) {
+        switch (stage()) {
+            case 0:
+                advance();
+                push(*stmt.condition);
+                return;
+            case 1: {
+                // The if stays below its branch, so nested ifs count towards the depth.
+                advance();
+                const Stmt* branch = pop() != 0.0 ? stmt.thenBranch.get() : stmt.elseBranch.get();
+                if (branch) {
+                    push(*branch);
+                    return;
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        finish();
+    }
+
+    void whileStmt(const WhileStmt& stmt) {
+        if (stage() == 0) {
+            advance();
+            push(*stmt.condition);
+            return;
+        }
+        if (pop() == 0.0) {
+            finish();
+            return;
+        }
+        // Back to stage 0 so the condition is checked again after the body.
+        work.back().stage = 0;
+        push(*stmt.body);
+    }
+
+    void print(const PrintStmt& stmt) {
+        if (stage() == 0) {
+            advance();
+            push(*stmt.expression);
+            return;
+        }
+        output->printNumber(pop());
+        finish();
+    }
+};
+
+// A program that runs a bounded number of steps at a time, keeping its output and errors.
+class ResumableScript {
+public:
+    ResumableScript(const std::vector<std::unique_ptr<Stmt>>& statements, size_t globalSlots)
+        : buffer(outputStream, FlushPolicy::ON_EXIT), evaluator(statements, globalSlots, buffer) {}
+
+    // Runs at most budget steps. Returns SUSPENDED if the program is not done yet.
+    ScriptStatus run(size_t budget) {
+        if (state != ScriptStatus::SUSPENDED) return state;
+        try {
+            if (evaluator.run(budget)) state = ScriptStatus::FINISHED;
+        } catch (const std::runtime_error& error) {
+            state = ScriptStatus::FAILED;
+            errorText += "Runtime error: " + std::string(error.what()) + "\n";
+        }
+        return state;
+    }
+
+    // Runs until budget steps or slice of time are used up, whichever comes first.
+    // The clock is only read every kClockInterval steps.
+    ScriptStatus run(size_t budget, std::chrono::nanoseconds slice) {
+        auto deadline = std::chrono::steady_clock::now() + slice;
+        while (budget > 0 && state == ScriptStatus::SUSPENDED) {
+            size_t chunk = std::min(budget, kClockInterval);
+            run(chunk);
+            budget -= chunk;
+            if (std::chrono::steady_clock::now() >= deadline) break;
+        }
+        return state;
+    }
+
+    void kill(const std::string& reason) {
+        if (state != ScriptStatus::SUSPENDED) return;
+        state = ScriptStatus::KILLED;
+        errorText += "Killed: " + reason + "\n";
+        evaluator.stop();
+    }
+
+    ScriptStatus status() const { return state; }
+    size_t steps() const { return evaluator.steps(); }
+    const std::string& errors() const { return errorText; }
+
+    std::string output() {
+        buffer.flush();
+        return outputStream.str();
+    }
+
+private:
+    static constexpr size_t kClockInterval = 1024;
+
+    std::ostringstream outputStream;
+    OutputBuffer buffer;  // after the stream it writes to
+    WorkStackEvaluator evaluator;
+    ScriptStatus state = ScriptStatus::SUSPENDED;
+    std::string errorText;
+};
+
+struct MultiplexStats {
+    size_t scripts = 0;
+    size_t slices = 0;
+    size_t steps = 0;
+    size_t killed = 0;
+    double longestSliceSeconds = 0;  // the worst wait a slice imposes on every other script
+    double seconds = 0;
+};
+
+// Runs many scripts on the calling thread, round-robin, sliceSteps steps at a time. A nonzero
+// sliceTime also ends a turn once that much time has passed.
+class ScriptMultiplexer {
+public:
+    explicit ScriptMultiplexer(size_t sliceSteps = 10000, size_t stepLimit = 0, int optimizationLevel = 1,
+                               std::chrono::nanoseconds sliceTime = std::chrono::nanoseconds::zero())
+        : sliceSteps(sliceSteps > 0 ? sliceSteps : 1), stepLimit(stepLimit), optimizationLevel(optimizationLevel),
+          sliceTime(sliceTime) {}
+
+    // Parses and resolves source, sharing the tree with earlier scripts of the same source.
+    void add(const std::string& name, const std::string& source) {
+        auto it = programBySource.find(source);
+        if (it == programBySource.end()) {
+            auto program = std::make_unique<CompiledScript>();
+            compileScript(source, optimizationLevel, *program);
+            it = programBySource.emplace(source, std::move(program)).first;
+        }
+        const CompiledScript& program = *it->second;
+        Task task;
+        task.name = name;
+        task.errors = program.errors;
+        if (program.valid) {
+            task.script = std::make_unique<ResumableScript>(program.statements, program.globalSlots);
+        }
+        tasks.push_back(std::move(task));
+    }
+
+    std::vector<BatchResult> run() {
+        using Clock = std::chrono::steady_clock;
+        auto start = Clock::now();
+        statistics = MultiplexStats();
+        statistics.scripts = tasks.size();
+
+        std::deque<size_t> ready;
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            if (tasks[i].script) ready.push_back(i);
+        }
+        while (!ready.empty()) {
+            size_t index = ready.front();
+            ready.pop_front();
+            ResumableScript& script = *tasks[index].script;
+
+            size_t budget = sliceSteps;
+            if (stepLimit > 0) budget = std::min(budget, stepLimit - script.steps());
+            auto sliceStart = Clock::now();
+            size_t before = script.steps();
+            ScriptStatus status = sliceTime > sliceTime.zero() ? script.run(budget, sliceTime) : script.run(budget);
+            statistics.longestSliceSeconds = std::max(
+                statistics.longestSliceSeconds, std::chrono::duration<double>(Clock::now() - sliceStart).count());
+            statistics.slices++;
+            statistics.steps += script.steps() - before;
+
+            if (status != ScriptStatus::SUSPENDED) continue;
+            if (stepLimit > 0 && script.steps() >= stepLimit) {
+                script.kill("step limit of " + std::to_string(stepLimit) + " exceeded");
+                statistics.killed++;
+                continue;
+            }
+            ready.push_back(index);
+        }
+
+        std::vector<BatchResult> results;
+        for (Task& task : tasks) {
+            BatchResult result;
+            result.name = task.name;
+            result.errors = task.errors;
+            if (task.script) {
+                result.output = task.script->output();
+                result.errors += task.script->errors();
+            }
+            results.push_back(std::move(result));
+        }
+        statistics.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        return results;
+    }
+
+    const MultiplexStats& stats() const { return statistics; }
+
+private:
+    struct Task {
+        std::string name;
+        std::string errors;
+        std::unique_ptr<ResumableScript> script;  // null when the program did not resolve
+    };
+
+    size_t sliceSteps;
+    size_t stepLimit;
+    int optimizationLevel;
+    std::chrono::nanoseconds sliceTime;
+    std::unordered_map<std::string, std::unique_ptr<CompiledScript>> programBySource;
+    std::vector<Task> tasks;
+    MultiplexStats statistics;
+};
+#endif
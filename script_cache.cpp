@@ -0,0 +1,640 @@
+#include "enviroment_interpretation.cpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SCRIPT_CACHE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// 11. Compiled-Script Cache (ScriptCache)
+// Stores the parsed, optimized and resolved tree of a script in a cache directory, keyed by a
+// hash of the source text and the optimization level. A later run of the same source maps the
+// file and rebuilds the tree straight from it, skipping lexing, parsing, optimization, loop
+// analysis and resolution. Files carry a magic number, a format version, the source hash and
+// size, and a checksum of the payload; anything that does not match is treated as a miss and
+// the script is compiled normally (and the entry rewritten).
+
+#ifndef SCRIPT_CACHE
+#define SCRIPT_CACHE
+
+class ScriptCache {
+public:
+    static constexpr uint32_t kMagic = 0x434c4d43;  // "CMLC"
+    static constexpr uint32_t kVersion = 1;
+
+    ScriptCache(std::string directory, int optimizationLevel)
+        : directory(std::move(directory)), optimizationLevel(optimizationLevel) {}
+
+    // Rebuilds the cached program for source in arena. Returns false (with lastResult()
+    // saying why) when there is no valid entry.
+    bool load(const std::string& source, AstArena& arena, std::vector<std::unique_ptr<Stmt>>& statements,
+              size_t& globalSlots) {
+        auto start = Clock::now();
+        std::vector<char> copy;
+        const char* data = nullptr;
+        size_t size = 0;
+        MappedFile mapped(pathFor(source));
+        if (mapped.data) {
+            data = mapped.data;
+            size = mapped.size;
+        } else if (!readFile(pathFor(source), copy)) {
+            result = "miss (no entry)";
+            return false;
+        } else {
+            data = copy.data();
+            size = copy.size();
+        }
+
+        Header header;
+        if (size < sizeof(Header)) return reject("file too short");
+        std::memcpy(&header, data, sizeof(Header));
+        if (header.magic != kMagic) return reject("bad magic");
+        if (header.version != kVersion) return reject("version " + std::to_string(header.version));
+        if (header.headerSize != sizeof(Header) || header.byteOrder != 0x01020304) {
+            return reject("incompatible layout");
+        }
+        if (header.sourceHash != hash(source.data(), source.size()) || header.sourceSize != source.size()) {
+            return reject("source mismatch");
+        }
+        if (header.payloadSize != size - sizeof(Header)) return reject("truncated");
+        const char* payload = data + sizeof(Header);
+        if (header.checksum != hash(payload, header.payloadSize)) return reject("checksum mismatch");
+
+        try {
+            ArenaScope scope(arena);
+            Reader reader(payload, header.payloadSize);
+            statements = reader.program();
+        } catch (const std::runtime_error& error) {
+            statements.clear();
+            return reject(error.what());
+        }
+        globalSlots = header.globalSlots;
+
+        loadSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+        savedSeconds = header.compileNanoseconds / 1e9 - loadSeconds;
+        result = "hit";
+        return true;
+    }
+
+    // Writes the compiled program for source; compileSeconds is what the cache will save.
+    bool store(const std::string& source, const std::vector<std::unique_ptr<Stmt>>& statements, size_t globalSlots,
+               double compileSeconds) {
+        Writer writer;
+        std::string payload = writer.program(statements);
+
+        Header header;
+        header.sourceHash = hash(source.data(), source.size());
+        header.sourceSize = source.size();
+        header.payloadSize = payload.size();
+        header.checksum = hash(payload.data(), payload.size());
+        header.globalSlots = globalSlots;
+        header.compileNanoseconds = static_cast<uint64_t>(compileSeconds * 1e9);
+
+        // Write to a temporary name and rename, so a reader never sees a half-written entry.
+        std::string path = pathFor(source);
+        std::string temporary = path + ".tmp" + std::to_string(Clock::now().time_since_epoch().count());
+        {
+            std::ofstream out(temporary, std::ios::binary);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+            if (!out) {
+                std::remove(temporary.c_str());
+                return false;
+            }
+        }
+        return std::rename(temporary.c_str(), path.c_str()) == 0;
+    }
+
+    // "hit", or why the last load() missed.
+    const std::string& lastResult() const { return result; }
+    double lastLoadSeconds() const { return loadSeconds; }
+    double lastSavedSeconds() const { return savedSeconds; }
+
+    std::string pathFor(const std::string& source) const {
+        char name[40];
+        std::snprintf(name, sizeof(name), "%016llx-O%d.cmlc",
+                      static_cast<unsigned long long>(hash(source.data(), source.size())), optimizationLevel);
+        return directory + "/" + name;
+    }
+
+    // 64-bit FNV-1a.
+    static uint64_t hash(const char* data, size_t size) {
+        uint64_t value = 14695981039346656037ull;
+        for (size_t i = 0; i < size; ++i) {
+            value = (value ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+        }
+        return value;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Header {
+        uint32_t magic = kMagic;
+        uint32_t version = kVersion;
+        uint32_t headerSize = sizeof(Header);
+        uint32_t byteOrder = 0x01020304;  // files are only read back on a machine with the same layout
+        uint64_t sourceHash = 0;
+        uint64_t sourceSize = 0;
+        uint64_t payloadSize = 0;
+        uint64_t checksum = 0;
+        uint64_t globalSlots = 0;
+        uint64_t compileNanoseconds = 0;
+    };
+
+    // Node tags of the payload.
+    enum Tag : uint8_t { LITERAL, VARIABLE, UNARY, BINARY, ASSIGNMENT, EXPRESSION, LET, BLOCK, IF, WHILE, PRINT };
+
+    // A read-only view of a cache file: mapped when the platform allows it.
+    struct MappedFile {
+        const char* data = nullptr;
+        size_t size = 0;
+
+        explicit MappedFile(const std::string& path) {
+#ifdef SCRIPT_CACHE_MMAP
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) return;
+            struct stat info;
+            if (fstat(fd, &info) == 0 && info.st_size > 0) {
+                void* memory = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (memory != MAP_FAILED) {
+                    data = static_cast<const char*>(memory);
+                    size = info.st_size;
+                }
+            }
+            close(fd);
+#else
+            (void)path;
+#endif
+        }
+
+        ~MappedFile() {
+#ifdef SCRIPT_CACHE_MMAP
+            if (data) munmap(const_cast<char*>(data), size);
+#endif
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+    };
+
+    // Serializes a tree in pre-order. Names and lexemes go through a string table. The tree is
+    // walked with an explicit work list, like the Resolver's, so any nesting depth can be stored.
+    class Writer {
+    public:
+        std::string program(const std::vector<std::unique_ptr<Stmt>>& statements) {
+            body.clear();
+            put<uint32_t>(static_cast<uint32_t>(statements.size()));
+            for (auto it = statements.rbegin(); it != statements.rend(); ++it) {
+                work.push_back({Work::STMT, it->get()});
+            }
+            run();
+
+            std::string out;
+            append(out, static_cast<uint32_t>(strings.size()));
+            for (const std::string& text : strings) {
+                append(out, static_cast<uint32_t>(text.size()));
+                out += text;
+            }
+            return out + body;
+        }
+
+    private:
+        // A node still to write, or the else part of an if whose then branch is written first.
+        struct Work {
+            enum Step : uint8_t { EXPR, STMT, ELSE };
+
+            Step step;
+            const void* node;
+        };
+
+        std::string body;
+        std::vector<std::string> strings;
+        std::unordered_map<uint32_t, uint32_t> stringIndex;  // symbol id -> string table index
+        std::vector<Work> work;
+
+        template <typename T>
+        static void append(std::string& out, T value) {
+            char bytes[sizeof(T)];
+            std::memcpy(bytes, &value, sizeof(T));
+            out.append(bytes, sizeof(T));
+        }
+
+        template <typename T>
+        void put(T value) { append(body, value); }
+
+        void put(const SymbolToken& token) {
+            auto it = stringIndex.find(token.symbol);
+            if (it == stringIndex.end()) {
+                it = stringIndex.emplace(token.symbol, static_cast<uint32_t>(strings.size())).first;
+                strings.emplace_back(token.lexeme);
+            }
+            put<uint8_t>(static_cast<uint8_t>(token.type));
+            put<uint32_t>(it->second);
+            put<int32_t>(token.line);
+        }
+
+        void push(const Expr* expr) { work.push_back({Work::EXPR, expr}); }
+        void push(const Stmt* stmt) { work.push_back({Work::STMT, stmt}); }
+
+        // Children are pushed in reverse, so they are written in pre-order.
+        void run() {
+            while (!work.empty()) {
+                Work item = work.back();
+                work.pop_back();
+                switch (item.step) {
+                    case Work::EXPR: write(*static_cast<const Expr*>(item.node)); break;
+                    case Work::STMT: write(*static_cast<const Stmt*>(item.node)); break;
+                    case Work::ELSE: {
+                        const auto& stmt = *static_cast<const IfStmt*>(item.node);
+                        put<uint8_t>(stmt.elseBranch != nullptr);
+                        if (stmt.elseBranch) push(stmt.elseBranch.get());
+                        break;
+                    }
+                }
+            }
+        }
+
+        void write(const Expr& expr) {
+            switch (expr.kind) {
+                case ExprKind::LITERAL:
+                    put<uint8_t>(LITERAL);
+                    put<double>(static_cast<const LiteralExpr&>(expr).value);
+                    break;
+                case ExprKind::VARIABLE: {
+                    const auto& variable = static_cast<const VariableExpr&>(expr);
+                    put<uint8_t>(VARIABLE);
+                    put(variable.name);
+                    put<int32_t>(variable.depth);
+                    put<int32_t>(variable.slot);
+                    break;
+                }
+                case ExprKind::UNARY: {
+                    const auto& unary = static_cast<const UnaryExpr&>(expr);
+                    put<uint8_t>(UNARY);
+                    put(unary.op);
+                    push(unary.right.get());
+                    break;
+                }
+                case ExprKind::BINARY: {
+                    const auto& binary = static_cast<const BinaryExpr&>(expr);
+                    put<uint8_t>(BINARY);
+                    put(binary.op);
+                    push(binary.right.get());
+                    push(binary.left.get());
+                    break;
+                }
+                case ExprKind::ASSIGNMENT: {
+                    const auto& assignment = static_cast<const AssignmentExpr&>(expr);
+                    put<uint8_t>(ASSIGNMENT);
+                    put(assignment.name);
+                    put<int32_t>(assignment.depth);
+                    put<int32_t>(assignment.slot);
+                    push(assignment.value.get());
+                    break;
+                }
+            }
+        }
+
+        void write(const Stmt& stmt) {
+            switch (stmt.kind) {
+                case StmtKind::EXPRESSION:
+                    put<uint8_t>(EXPRESSION);
+                    put<int32_t>(stmt.line);
+                    push(static_cast<const ExpressionStmt&>(stmt).expression.get());
+                    break;
+                case StmtKind::VARIABLE_DECLARATION: {
+                    const auto& declaration = static_cast<const VariableDeclarationStmt&>(stmt);
+                    put<uint8_t>(LET);
+                    put<int32_t>(stmt.line);
+                    put(declaration.name);
+                    put<int32_t>(declaration.depth);
+                    put<int32_t>(declaration.slot);
+                    put<uint8_t>(declaration.initializer != nullptr);
+                    if (declaration.initializer) push(declaration.initializer.get());
+                    break;
+                }
+                case StmtKind::BLOCK: {
+                    const auto& block = static_cast<const BlockStmt&>(stmt);
+                    put<uint8_t>(BLOCK);
+                    put<int32_t>(stmt.line);
+                    put<int32_t>(block.slotCount);
+                    put<uint32_t>(static_cast<uint32_t>(block.statements.size()));
+                    for (auto it = block.statements.rbegin(); it != block.statements.rend(); ++it) {
+                        push(it->get());
+                    }
+                    break;
+                }
+                case StmtKind::IF: {
+                    const auto& ifStmt = static_cast<const IfStmt&>(stmt);
+                    put<uint8_t>(IF);
+                    put<int32_t>(stmt.line);
+                    work.push_back({Work::ELSE, &ifStmt});
+                    push(ifStmt.thenBranch.get());
+                    push(ifStmt.condition.get());
+                    break;
+                }
+                case StmtKind::WHILE: {
+                    const auto& loop = static_cast<const WhileStmt&>(stmt);
+                    put<uint8_t>(WHILE);
+                    put<int32_t>(stmt.line);
+                    put<int64_t>(loop.tripCount);
+                    push(loop.body.get());
+                    push(loop.condition.get());
+                    break;
+                }
+                case StmtKind::PRINT:
+                    put<uint8_t>(PRINT);
+                    put<int32_t>(stmt.line);
+                    push(static_cast<const PrintStmt&>(stmt).expression.get());
+                    break;
+            }
+        }
+    };
+
+    // Rebuilds a tree from a payload. Every read is bounds-checked. Nodes are read in pre-order
+    // from a work list; a node with children leaves a BUILD entry under the reads of its children,
+    // which assembles it from the expression and statement stacks once they are done.
+    class Reader {
+    public:
+        Reader(const char* data, size_t size) : next(data), end(data + size) {}
+
+        std::vector<std::unique_ptr<Stmt>> program() {
+            uint32_t stringCount = get<uint32_t>();
+            for (uint32_t i = 0; i < stringCount; ++i) {
+                uint32_t length = get<uint32_t>();
+                require(length);
+                strings.emplace_back(next, length);
+                next += length;
+            }
+
+            uint32_t count = get<uint32_t>();
+            require(count);  // every statement takes at least a byte, so a bad count cannot allocate much
+            try {
+                for (uint32_t i = 0; i < count; ++i) work.push_back({Work::STMT});
+                run();
+                if (next != end) throw std::runtime_error("trailing bytes");
+            } catch (const std::runtime_error&) {
+                // Whatever was built so far is released without recursion before reporting the error.
+                TreeReleaser releaser;
+                for (auto& expr : expressions) releaser.add(std::move(expr));
+                releaser.add(statements);
+                releaser.run();
+                throw;
+            }
+            return std::move(statements);
+        }
+
+    private:
+        // A node to read, or one to assemble (BUILD) with what its header said.
+        struct Work {
+            enum Step : uint8_t { EXPR, STMT, ELSE, BUILD };
+
+            Work(Step step) : step(step) {}
+
+            Step step;
+            uint8_t tag = 0;
+            int line = 0;
+            SymbolToken token;     // operator or name
+            int depth = -1;
+            int slot = -1;
+            uint32_t count = 0;    // statements of a block
+            int64_t extra = 0;     // slot count of a block, trip count of a loop
+        };
+
+        const char* next;
+        const char* end;
+        std::vector<std::string> strings;
+        std::vector<Work> work;
+        std::vector<std::unique_ptr<Expr>> expressions;  // finished, waiting for their parent
+        std::vector<std::unique_ptr<Stmt>> statements;   // a missing initializer or else is null
+
+        void require(size_t bytes) {
+            if (static_cast<size_t>(end - next) < bytes) throw std::runtime_error("unexpected end of payload");
+        }
+
+        template <typename T>
+        T get() {
+            require(sizeof(T));
+            T value;
+            std::memcpy(&value, next, sizeof(T));
+            next += sizeof(T);
+            return value;
+        }
+
+        SymbolToken token() {
+            TokenType type = static_cast<TokenType>(get<uint8_t>());
+            uint32_t index = get<uint32_t>();
+            int line = get<int32_t>();
+            if (index >= strings.size()) throw std::runtime_error("bad string index");
+            return SymbolToken(type, strings[index], line);
+        }
+
+        std::unique_ptr<Expr> popExpression() {
+            if (expressions.empty()) throw std::runtime_error("malformed payload");
+            std::unique_ptr<Expr> expr = std::move(expressions.back());
+            expressions.pop_back();
+            return expr;
+        }
+
+        std::unique_ptr<Stmt> popStatement() {
+            if (statements.empty()) throw std::runtime_error("malformed payload");
+            std::unique_ptr<Stmt> stmt = std::move(statements.back());
+            statements.pop_back();
+            return stmt;
+        }
+
+        // Pushes build, then the reads of its children in reverse, so they are read in order.
+        void expect(Work build, std::initializer_list<Work::Step> children) {
+            work.push_back(std::move(build));
+            for (auto it = std::rbegin(children); it != std::rend(children); ++it) work.push_back({*it});
+        }
+
+        void run() {
+            while (!work.empty()) {
+                Work item = std::move(work.back());
+                work.pop_back();
+                switch (item.step) {
+                    case Work::EXPR: readExpression(); break;
+                    case Work::STMT: readStatement(); break;
+                    case Work::ELSE:
+                        if (get<uint8_t>()) {
+                            work.push_back({Work::STMT});
+                        } else {
+                            statements.push_back(nullptr);
+                        }
+                        break;
+                    case Work::BUILD: build(item); break;
+                }
+            }
+        }
+
+        void readExpression() {
+            Work build(Work::BUILD);
+            build.tag = get<uint8_t>();
+            switch (build.tag) {
+                case LITERAL:
+                    expressions.push_back(std::make_unique<LiteralExpr>(get<double>()));
+                    return;
+                case VARIABLE: {
+                    auto expr = std::make_unique<VariableExpr>(token());
+                    expr->depth = get<int32_t>();
+                    expr->slot = get<int32_t>();
+                    expressions.push_back(std::move(expr));
+                    return;
+                }
+                case UNARY:
+                    build.token = token();
+                    expect(std::move(build), {Work::EXPR});
+                    return;
+                case BINARY:
+                    build.token = token();
+                    expect(std::move(build), {Work::EXPR, Work::EXPR});
+                    return;
+                case ASSIGNMENT:
+                    build.token = token();
+                    build.depth = get<int32_t>();
+                    build.slot = get<int32_t>();
+                    expect(std::move(build), {Work::EXPR});
+                    return;
+                default:
+                    throw std::runtime_error("bad expression tag");
+            }
+        }
+
+        void readStatement() {
+            Work build(Work::BUILD);
+            build.tag = get<uint8_t>();
+            build.line = get<int32_t>();
+            switch (build.tag) {
+                case EXPRESSION:
+                case PRINT:
+                    expect(std::move(build), {Work::EXPR});
+                    return;
+                case LET:
+                    build.token = token();
+                    build.depth = get<int32_t>();
+                    build.slot = get<int32_t>();
+                    if (get<uint8_t>()) {
+                        expect(std::move(build), {Work::EXPR});
+                    } else {
+                        expressions.push_back(nullptr);
+                        work.push_back(std::move(build));
+                    }
+                    return;
+                case BLOCK: {
+                    build.extra = get<int32_t>();
+                    uint32_t count = get<uint32_t>();
+                    require(count);
+                    build.count = count;
+                    work.push_back(std::move(build));
+                    for (uint32_t i = 0; i < count; ++i) work.push_back({Work::STMT});
+                    return;
+                }
+                case IF:
+                    expect(std::move(build), {Work::EXPR, Work::STMT, Work::ELSE});
+                    return;
+                case WHILE:
+                    build.extra = get<int64_t>();
+                    expect(std::move(build), {Work::EXPR, Work::STMT});
+                    return;
+                default:
+                    throw std::runtime_error("bad statement tag");
+            }
+        }
+
+        void build(Work& item) {
+            switch (item.tag) {
+                case UNARY:
+                    expressions.push_back(std::make_unique<UnaryExpr>(item.token, popExpression()));
+                    return;
+                case BINARY: {
+                    auto right = popExpression();
+                    auto left = popExpression();
+                    expressions.push_back(std::make_unique<BinaryExpr>(std::move(left), item.token, std::move(right)));
+                    return;
+                }
+                case ASSIGNMENT: {
+                    auto expr = std::make_unique<AssignmentExpr>(item.token, popExpression());
+                    expr->depth = item.depth;
+                    expr->slot = item.slot;
+                    expressions.push_back(std::move(expr));
+                    return;
+                }
+                default:
+                    break;
+            }
+
+            std::unique_ptr<Stmt> stmt;
+            switch (item.tag) {
+                case EXPRESSION:
+                    stmt = std::make_unique<ExpressionStmt>(popExpression());
+                    break;
+                case PRINT:
+                    stmt = std::make_unique<PrintStmt>(popExpression());
+                    break;
+                case LET: {
+                    auto declaration = std::make_unique<VariableDeclarationStmt>(item.token, popExpression());
+                    declaration->depth = item.depth;
+                    declaration->slot = item.slot;
+                    stmt = std::move(declaration);
+                    break;
+                }
+                case BLOCK: {
+                    if (statements.size() < item.count) throw std::runtime_error("malformed payload");
+                    std::vector<std::unique_ptr<Stmt>> body(std::make_move_iterator(statements.end() - item.count),
+                                                            std::make_move_iterator(statements.end()));
+                    statements.resize(statements.size() - item.count);
+                    auto block = std::make_unique<BlockStmt>(std::move(body));
+                    block->slotCount = static_cast<int>(item.extra);
+                    stmt = std::move(block);
+                    break;
+                }
+                case IF: {
+                    auto elseBranch = popStatement();
+                    auto thenBranch = popStatement();
+                    stmt = std::make_unique<IfStmt>(popExpression(), std::move(thenBranch), std::move(elseBranch));
+                    break;
+                }
+                case WHILE: {
+                    auto body = popStatement();
+                    auto loop = std::make_unique<WhileStmt>(popExpression(), std::move(body));
+                    loop->tripCount = item.extra;
+                    stmt = std::move(loop);
+                    break;
+                }
+                default:
+                    throw std::runtime_error("bad statement tag");
+            }
+            stmt->line = item.line;
+            statements.push_back(std::move(stmt));
+        }
+    };
+
+    std::string directory;
+    int optimizationLevel;
+    std::string result = "not loaded";
+    double loadSeconds = 0;
+    double savedSeconds = 0;
+
+    bool reject(const std::string& reason) {
+        result = "miss (" + reason + ")";
+        return false;
+    }
+
+    static bool readFile(const std::string& path, std::vector<char>& contents) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+        contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        return true;
+    }
+};
+#endif
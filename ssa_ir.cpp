@@ -0,0 +1,1134 @@
+#include "enviroment_interpretation.cpp"
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <tuple>
+
+// 18. SSA Middle-End (SsaCompiler, RegisterVM)
+// Lowers a resolved program into a control-flow graph in SSA form and optimizes it there, where
+// a value computed in one statement can be reused by every statement it dominates. The SSA form
+// is built directly from the tree with Braun et al.'s algorithm (phis are placed on demand at
+// `if` joins and loop headers and dropped again when trivial). The passes are
+//   copy propagation    uses of `x = y` copies read y; phis whose inputs agree are removed
+//   value numbering     an expression computed again on a dominated path reuses the first
+//                       result; operations on constants are folded
+//   dead code           values nothing prints, branches on or needs are dropped, which also
+//                       removes stores to variables that are never read again
+// The result is taken out of SSA onto a register machine: linear-scan allocation over one
+// live interval per value, with spills and constants addressed like registers, and phis turned
+// into parallel moves at the end of each predecessor. Every `if` has an else block, so no edge
+// leads from a block with two successors to one with two predecessors, and the moves always
+// have a place of their own.
+
+#ifndef SSA_IR
+#define SSA_IR
+
+enum class IrOp : uint8_t {
+    CONST, COPY, PHI,
+    NEG, NOT,
+    ADD, SUBTRACT, MULTIPLY, DIVIDE,
+    GREATER, GREATER_EQUAL, LESS, LESS_EQUAL, EQUAL, NOT_EQUAL,
+    PRINT
+};
+
+struct IrValue {
+    IrOp op;
+    uint32_t block;
+    uint32_t a = UINT32_MAX;         // operands, kNone when unused
+    uint32_t b = UINT32_MAX;
+    double constant = 0;
+    int line = 0;
+    uint32_t name = UINT32_MAX;      // variable symbol of copies and phis, for dumps
+    std::vector<uint32_t> inputs;    // phi inputs, one per predecessor of the block
+    uint32_t replacement = UINT32_MAX;  // the value this one was replaced by
+    bool removed = false;
+};
+
+enum class IrExit : uint8_t { JUMP, BRANCH, RETURN };
+
+struct IrBlock {
+    std::vector<uint32_t> values;        // phis first
+    std::vector<uint32_t> predecessors;
+    IrExit exit = IrExit::RETURN;
+    uint32_t condition = UINT32_MAX;
+    uint32_t target = UINT32_MAX;        // JUMP target, or BRANCH target when the condition holds
+    uint32_t otherwise = UINT32_MAX;     // BRANCH target when it does not
+    uint32_t loop = UINT32_MAX;          // innermost loop containing the block
+};
+
+// A while loop: its blocks are header..latch, in order.
+struct IrLoop {
+    uint32_t header;
+    uint32_t latch;
+    uint32_t parent;
+};
+
+struct IrProgram {
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    std::vector<IrValue> values;
+    std::vector<IrBlock> blocks;  // blocks[0] is the entry; every block comes after its dominators
+    std::vector<IrLoop> loops;
+
+    uint32_t resolve(uint32_t value) const {
+        while (values[value].replacement != kNone) value = values[value].replacement;
+        return value;
+    }
+
+    void replace(uint32_t value, uint32_t by) {
+        values[value].replacement = by;
+        values[value].removed = true;
+    }
+
+    // Drops removed values from the blocks and points every operand at its replacement.
+    void compact() {
+        for (IrBlock& block : blocks) {
+            size_t kept = 0;
+            for (uint32_t value : block.values) {
+                if (!values[value].removed) block.values[kept++] = value;
+            }
+            block.values.resize(kept);
+            for (uint32_t value : block.values) {
+                IrValue& v = values[value];
+                if (v.a != kNone) v.a = resolve(v.a);
+                if (v.b != kNone) v.b = resolve(v.b);
+                for (uint32_t& input : v.inputs) input = resolve(input);
+            }
+            if (block.condition != kNone) block.condition = resolve(block.condition);
+        }
+    }
+
+    size_t liveValues() const {
+        size_t count = 0;
+        for (const IrBlock& block : blocks) count += block.values.size();
+        return count;
+    }
+
+    void dump(std::ostream& out, const std::string& title) const {
+        out << "== " << title << " (" << liveValues() << " values, " << blocks.size() << " blocks)\n";
+        for (size_t b = 0; b < blocks.size(); ++b) {
+            const IrBlock& block = blocks[b];
+            out << "b" << b << ":";
+            if (!block.predecessors.empty()) {
+                out << " <-";
+                for (uint32_t predecessor : block.predecessors) out << " b" << predecessor;
+            }
+            out << "\n";
+            for (uint32_t value : block.values) {
+                const IrValue& v = values[value];
+                out << "  ";
+                if (v.op != IrOp::PRINT) out << "v" << value << " = ";
+                out << opName(v.op);
+                if (v.op == IrOp::CONST) out << " " << v.constant;
+                if (v.a != kNone) out << " v" << v.a;
+                if (v.b != kNone) out << " v" << v.b;
+                for (uint32_t input : v.inputs) out << " v" << input;
+                if (v.name != kNone) out << "    ; " << SymbolTable::global().name(v.name);
+                out << "\n";
+            }
+            switch (block.exit) {
+                case IrExit::JUMP: out << "  jump b" << block.target << "\n"; break;
+                case IrExit::BRANCH:
+                    out << "  branch v" << block.condition << " b" << block.target << " b" << block.otherwise << "\n";
+                    break;
+                case IrExit::RETURN: out << "  return\n"; break;
+            }
+        }
+    }
+
+    static const char* opName(IrOp op) {
+        switch (op) {
+            case IrOp::CONST: return "const";
+            case IrOp::COPY: return "copy";
+            case IrOp::PHI: return "phi";
+            case IrOp::NEG: return "neg";
+            case IrOp::NOT: return "not";
+            case IrOp::ADD: return "add";
+            case IrOp::SUBTRACT: return "sub";
+            case IrOp::MULTIPLY: return "mul";
+            case IrOp::DIVIDE: return "div";
+            case IrOp::GREATER: return "gt";
+            case IrOp::GREATER_EQUAL: return "ge";
+            case IrOp::LESS: return "lt";
+            case IrOp::LESS_EQUAL: return "le";
+            case IrOp::EQUAL: return "eq";
+            case IrOp::NOT_EQUAL: return "ne";
+            case IrOp::PRINT: return "print";
+        }
+        return "?";
+    }
+};
+
+// Lowers a resolved pointer tree into an IrProgram in SSA form. Variables are numbered by their
+// absolute slot, each block scope sitting right above the scope that encloses it.
+class SsaBuilder : public ExprVisitor, public StmtVisitor {
+public:
+    IrProgram build(const std::vector<std::unique_ptr<Stmt>>& statements, size_t globalSlots) {
+        program = IrProgram();
+        definitions.clear();
+        incompletePhis.clear();
+        sealed.clear();
+        loopStack.clear();
+        variableNames.clear();
+        scopes.assign(1, Scope{0, globalSlots});
+
+        current = newBlock();
+        seal(current);
+        zero = emitConstant(0.0);  // what a variable holds before its first assignment
+        for (const auto& stmt : statements) {
+            stmt->accept(*this);
+        }
+        program.blocks[current].exit = IrExit::RETURN;
+        return std::move(program);
+    }
+
+private:
+    static constexpr uint32_t kNone = IrProgram::kNone;
+
+    struct Scope {
+        size_t base;
+        size_t size;
+    };
+
+    IrProgram program;
+    uint32_t current = 0;
+    uint32_t result = 0;
+    uint32_t zero = 0;
+    std::vector<Scope> scopes;
+    std::vector<std::unordered_map<uint32_t, uint32_t>> definitions;     // per block: variable -> value
+    std::vector<std::unordered_map<uint32_t, uint32_t>> incompletePhis;  // per unsealed block
+    std::vector<bool> sealed;
+    std::vector<uint32_t> loopStack;
+    std::unordered_map<uint32_t, uint32_t> variableNames;  // variable -> symbol, for dumps
+
+    uint32_t newBlock() {
+        program.blocks.emplace_back();
+        program.blocks.back().loop = loopStack.empty() ? kNone : loopStack.back();
+        definitions.emplace_back();
+        incompletePhis.emplace_back();
+        sealed.push_back(false);
+        return static_cast<uint32_t>(program.blocks.size() - 1);
+    }
+
+    uint32_t emit(IrOp op, uint32_t a = kNone, uint32_t b = kNone, int line = 0) {
+        IrValue value;
+        value.op = op;
+        value.block = current;
+        value.a = a;
+        value.b = b;
+        value.line = line;
+        program.values.push_back(std::move(value));
+        uint32_t index = static_cast<uint32_t>(program.values.size() - 1);
+        program.blocks[current].values.push_back(index);
+        return index;
+    }
+
+    uint32_t emitConstant(double constant) {
+        uint32_t index = emit(IrOp::CONST);
+        program.values[index].constant = constant;
+        return index;
+    }
+
+    void jump(uint32_t from, uint32_t to) {
+        program.blocks[from].exit = IrExit::JUMP;
+        program.blocks[from].target = to;
+        program.blocks[to].predecessors.push_back(from);
+    }
+
+    uint32_t variable(int depth, int slot, const SymbolToken& name) const {
+        if (slot < 0 || depth < 0 || static_cast<size_t>(depth) >= scopes.size()) {
+            throw std::runtime_error("Variable '" + std::string(name.lexeme) + "' at line " + std::to_string(name.line) +
+                                     " was not resolved before lowering");
+        }
+        return static_cast<uint32_t>(scopes[scopes.size() - 1 - depth].base + static_cast<size_t>(slot));
+    }
+
+    // Braun et al., "Simple and Efficient Construction of Static Single Assignment Form".
+    void write(uint32_t variable, uint32_t block, uint32_t value) {
+        definitions[block][variable] = value;
+    }
+
+    uint32_t read(uint32_t variable, uint32_t block) {
+        auto it = definitions[block].find(variable);
+        if (it != definitions[block].end()) return program.resolve(it->second);
+        return readRecursive(variable, block);
+    }
+
+    uint32_t readRecursive(uint32_t variable, uint32_t block) {
+        const std::vector<uint32_t>& predecessors = program.blocks[block].predecessors;
+        uint32_t value;
+        if (!sealed[block]) {
+            value = newPhi(variable, block);
+            incompletePhis[block][variable] = value;
+        } else if (predecessors.empty()) {
+            value = zero;
+        } else if (predecessors.size() == 1) {
+            value = read(variable, predecessors[0]);
+        } else {
+            uint32_t phi = newPhi(variable, block);
+            write(variable, block, phi);
+            value = addPhiInputs(variable, phi);
+        }
+        write(variable, block, value);
+        return value;
+    }
+
+    uint32_t newPhi(uint32_t variable, uint32_t block) {
+        IrValue phi;
+        phi.op = IrOp::PHI;
+        phi.block = block;
+        auto name = variableNames.find(variable);
+        phi.name = name != variableNames.end() ? name->second : kNone;
+        program.values.push_back(std::move(phi));
+        uint32_t index = static_cast<uint32_t>(program.values.size() - 1);
+        std::vector<uint32_t>& values = program.blocks[block].values;
+        values.insert(values.begin(), index);
+        return index;
+    }
+
+    uint32_t addPhiInputs(uint32_t variable, uint32_t phi) {
+        uint32_t block = program.values[phi].block;
+        for (uint32_t predecessor : program.blocks[block].predecessors) {
+            uint32_t input = read(variable, predecessor);
+            program.values[phi].inputs.push_back(input);
+        }
+        return removeIfTrivial(phi);
+    }
+
+    // A phi whose inputs are all one value (or itself) is that value.
+    uint32_t removeIfTrivial(uint32_t phi) {
+        uint32_t same = kNone;
+        for (uint32_t input : program.values[phi].inputs) {
+            input = program.resolve(input);
+            if (input == same || input == phi) continue;
+            if (same != kNone) return phi;
+            same = input;
+        }
+        if (same == kNone) same = zero;
+        program.replace(phi, same);
+        return same;
+    }
+
+    void seal(uint32_t block) {
+        for (const auto& [variable, phi] : incompletePhis[block]) {
+            addPhiInputs(variable, phi);
+        }
+        incompletePhis[block].clear();
+        sealed[block] = true;
+    }
+
+    void store(uint32_t variable, const SymbolToken& name, uint32_t value) {
+        variableNames[variable] = name.symbol;
+        uint32_t copy = emit(IrOp::COPY, value);
+        program.values[copy].name = name.symbol;
+        write(variable, current, copy);
+        result = copy;
+    }
+
+    uint32_t lower(Expr& expr) {
+        expr.accept(*this);
+        return result;
+    }
+
+    // ExprVisitor implementations
+    void visitLiteralExpr(LiteralExpr& expr) override {
+        result = emitConstant(expr.value);
+    }
+
+    void visitVariableExpr(VariableExpr& expr) override {
+        result = read(variable(expr.depth, expr.slot, expr.name), current);
+    }
+
+    void visitUnaryExpr(UnaryExpr& expr) override {
+        uint32_t right = lower(*expr.right);
+        switch (expr.op.type) {
+            case TokenType::MINUS: result = emit(IrOp::NEG, right, kNone, expr.op.line); break;
+            case TokenType::BANG: result = emit(IrOp::NOT, right, kNone, expr.op.line); break;
+            default:
+                throw std::runtime_error("Unknown unary operator at line " + std::to_string(expr.op.line));
+        }
+    }
+
+    void visitBinaryExpr(BinaryExpr& expr) override {
+        uint32_t left = lower(*expr.left);
+        uint32_t right = lower(*expr.right);
+        IrOp op;
+        switch (expr.op.type) {
+            case TokenType::PLUS: op = IrOp::ADD; break;
+            case TokenType::MINUS: op = IrOp::SUBTRACT; break;
+            case TokenType::STAR: op = IrOp::MULTIPLY; break;
+            case TokenType::SLASH: op = IrOp::DIVIDE; break;
+            case TokenType::GREATER: op = IrOp::GREATER; break;
+            case TokenType::GREATER_EQUAL: op = IrOp::GREATER_EQUAL; break;
+            case TokenType::LESS: op = IrOp::LESS; break;
+            case TokenType::LESS_EQUAL: op = IrOp::LESS_EQUAL; break;
+            case TokenType::EQUAL_EQUAL: op = IrOp::EQUAL; break;
+            case TokenType::BANG_EQUAL: op = IrOp::NOT_EQUAL; break;
+            default:
+                throw std::runtime_error("Unknown binary operator at line " + std::to_string(expr.op.line));
+        }
+        result = emit(op, left, right, expr.op.line);
+    }
+
+    void visitAssignmentExpr(AssignmentExpr& expr) override {
+        uint32_t target = variable(expr.depth, expr.slot, expr.name);
+        uint32_t value = lower(*expr.value);
+        store(target, expr.name, value);
+    }
+
+    // StmtVisitor implementations
+    void visitExpressionStmt(ExpressionStmt& stmt) override {
+        lower(*stmt.expression);
+    }
+
+    void visitVariableDeclarationStmt(VariableDeclarationStmt& stmt) override {
+        uint32_t target = variable(0, stmt.slot, stmt.name);
+        uint32_t value = stmt.initializer ? lower(*stmt.initializer) : emitConstant(0.0);
+        store(target, stmt.name, value);
+    }
+
+    void visitBlockStmt(BlockStmt& stmt) override {
+        const Scope& enclosing = scopes.back();
+        scopes.push_back(Scope{enclosing.base + enclosing.size, static_cast<size_t>(std::max(stmt.slotCount, 0))});
+        for (const auto& inner : stmt.statements) {
+            inner->accept(*this);
+        }
+        scopes.pop_back();
+    }
+
+    void visitIfStmt(IfStmt& stmt) override {
+        uint32_t condition = lower(*stmt.condition);
+        uint32_t branch = current;
+        program.blocks[branch].exit = IrExit::BRANCH;
+        program.blocks[branch].condition = condition;
+
+        uint32_t thenBlock = newBlock();
+        program.blocks[branch].target = thenBlock;
+        program.blocks[thenBlock].predecessors.push_back(branch);
+        seal(thenBlock);
+        current = thenBlock;
+        stmt.thenBranch->accept(*this);
+        uint32_t thenEnd = current;
+
+        // Always an else block, even an empty one, so the join never has a branching predecessor.
+        uint32_t elseBlock = newBlock();
+        program.blocks[branch].otherwise = elseBlock;
+        program.blocks[elseBlock].predecessors.push_back(branch);
+        seal(elseBlock);
+        current = elseBlock;
+        if (stmt.elseBranch) stmt.elseBranch->accept(*this);
+        uint32_t elseEnd = current;
+
+        uint32_t join = newBlock();
+        jump(thenEnd, join);
+        jump(elseEnd, join);
+        seal(join);
+        current = join;
+    }
+
+    void visitWhileStmt(WhileStmt& stmt) override {
+        uint32_t loop = static_cast<uint32_t>(program.loops.size());
+        program.loops.push_back(IrLoop{kNone, kNone, loopStack.empty() ? kNone : loopStack.back()});
+        loopStack.push_back(loop);
+
+        // The header stays unsealed until the body's back edge is known.
+        uint32_t header = newBlock();
+        jump(current, header);
+        current = header;
+        uint32_t condition = lower(*stmt.condition);
+
+        uint32_t body = newBlock();
+        program.blocks[body].predecessors.push_back(header);
+        seal(body);
+        current = body;
+        stmt.body->accept(*this);
+        uint32_t latch = current;
+        jump(latch, header);
+        seal(header);
+
+        loopStack.pop_back();
+        program.loops[loop].header = header;
+        program.loops[loop].latch = latch;
+
+        uint32_t exit = newBlock();
+        program.blocks[header].exit = IrExit::BRANCH;
+        program.blocks[header].condition = condition;
+        program.blocks[header].target = body;
+        program.blocks[header].otherwise = exit;
+        program.blocks[exit].predecessors.push_back(header);
+        seal(exit);
+        current = exit;
+    }
+
+    void visitPrintStmt(PrintStmt& stmt) override {
+        uint32_t value = lower(*stmt.expression);
+        emit(IrOp::PRINT, value);
+    }
+};
+
+enum class RegisterOp : uint8_t {
+    MOVE,
+    NEG, NOT,
+    ADD, SUBTRACT, MULTIPLY, DIVIDE,
+    GREATER, GREATER_EQUAL, LESS, LESS_EQUAL, EQUAL, NOT_EQUAL,
+    PRINT,
+    JUMP,           // a = target
+    JUMP_IF_FALSE,  // a = condition, b = target
+    HALT
+};
+
+// Operands index one frame: registers, then spill slots, then constants, then a scratch slot.
+struct RegisterInstruction {
+    RegisterOp op;
+    uint32_t destination;
+    uint32_t a;
+    uint32_t b;
+    int line;
+};
+
+struct RegisterProgram {
+    std::vector<RegisterInstruction> code;
+    std::vector<double> frame;  // initial contents: zeros, then the constants
+    uint32_t registers = 0;
+    uint32_t spillSlots = 0;
+    uint32_t constants = 0;
+
+    std::string operand(uint32_t index) const {
+        if (index < registers) return "r" + std::to_string(index);
+        if (index < registers + spillSlots) return "s" + std::to_string(index - registers);
+        if (index < registers + spillSlots + constants) {
+            std::ostringstream text;
+            text << "#" << frame[index];
+            return text.str();
+        }
+        return "tmp";
+    }
+
+    void dump(std::ostream& out) const {
+        out << "== register code (" << code.size() << " instructions, " << registers << " registers, "
+            << spillSlots << " spill slots, " << constants << " constants)\n";
+        for (size_t i = 0; i < code.size(); ++i) {
+            const RegisterInstruction& instruction = code[i];
+            out << "  " << i << ": ";
+            switch (instruction.op) {
+                case RegisterOp::PRINT: out << "print " << operand(instruction.a); break;
+                case RegisterOp::JUMP: out << "jump " << instruction.a; break;
+                case RegisterOp::JUMP_IF_FALSE:
+                    out << "jump_if_false " << operand(instruction.a) << " " << instruction.b;
+                    break;
+                case RegisterOp::HALT: out << "halt"; break;
+                case RegisterOp::MOVE:
+                    out << operand(instruction.destination) << " = " << operand(instruction.a);
+                    break;
+                case RegisterOp::NEG:
+                case RegisterOp::NOT:
+                    out << operand(instruction.destination) << " = " << opName(instruction.op) << " "
+                        << operand(instruction.a);
+                    break;
+                default:
+                    out << operand(instruction.destination) << " = " << opName(instruction.op) << " "
+                        << operand(instruction.a) << " " << operand(instruction.b);
+                    break;
+            }
+            out << "\n";
+        }
+    }
+
+    static const char* opName(RegisterOp op) {
+        switch (op) {
+            case RegisterOp::NEG: return "neg";
+            case RegisterOp::NOT: return "not";
+            case RegisterOp::ADD: return "add";
+            case RegisterOp::SUBTRACT: return "sub";
+            case RegisterOp::MULTIPLY: return "mul";
+            case RegisterOp::DIVIDE: return "div";
+            case RegisterOp::GREATER: return "gt";
+            case RegisterOp::GREATER_EQUAL: return "ge";
+            case RegisterOp::LESS: return "lt";
+            case RegisterOp::LESS_EQUAL: return "le";
+            case RegisterOp::EQUAL: return "eq";
+            case RegisterOp::NOT_EQUAL: return "ne";
+            default: return "?";
+        }
+    }
+};
+
+struct SsaStats {
+    size_t lowered = 0;          // values right after lowering
+    size_t copies = 0;           // copies propagated
+    size_t phis = 0;             // trivial phis removed by the passes
+    size_t numbered = 0;         // redundant values replaced by an earlier equal one
+    size_t folded = 0;           // operations on constants computed at compile time
+    size_t dead = 0;             // values removed as dead
+    size_t optimized = 0;        // values left for the register machine
+    uint32_t registers = 0;
+    uint32_t spilled = 0;
+    size_t instructions = 0;
+};
+
+// Lowers, optimizes and allocates a program. With a dump stream, the IR is written to it after
+// lowering and after every pass, followed by the register code.
+class SsaCompiler {
+public:
+    static constexpr uint32_t kRegisters = 16;
+
+    explicit SsaCompiler(std::ostream* dump = nullptr) : dumpStream(dump) {}
+
+    RegisterProgram compile(const std::vector<std::unique_ptr<Stmt>>& statements, size_t globalSlots) {
+        statistics = SsaStats();
+        SsaBuilder builder;
+        program = builder.build(statements, globalSlots);
+        program.compact();
+        statistics.lowered = program.liveValues();
+        dump("lowered");
+
+        propagateCopies();
+        dump("after copy propagation");
+        numberValues();
+        dump("after value numbering");
+        eliminateDeadCode();
+        dump("after dead code elimination");
+        statistics.optimized = program.liveValues();
+
+        RegisterProgram code = allocate();
+        statistics.registers = code.registers;
+        statistics.instructions = code.code.size();
+        if (dumpStream) code.dump(*dumpStream);
+        return code;
+    }
+
+    const SsaStats& stats() const { return statistics; }
+
+private:
+    static constexpr uint32_t kNone = IrProgram::kNone;
+
+    std::ostream* dumpStream;
+    IrProgram program;
+    SsaStats statistics;
+
+    void dump(const std::string& title) {
+        if (dumpStream) program.dump(*dumpStream, title);
+    }
+
+    // Copy propagation
+    void propagateCopies() {
+        for (IrValue& value : program.values) {
+            if (value.op == IrOp::COPY && !value.removed) {
+                program.replace(static_cast<uint32_t>(&value - program.values.data()), program.resolve(value.a));
+                statistics.copies++;
+            }
+        }
+        removeTrivialPhis();
+        program.compact();
+    }
+
+    // Phis can become trivial once the values their inputs named were merged; repeat to a fixpoint.
+    void removeTrivialPhis() {
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (uint32_t v = 0; v < program.values.size(); ++v) {
+                IrValue& phi = program.values[v];
+                if (phi.op != IrOp::PHI || phi.removed) continue;
+                uint32_t same = kNone;
+                bool trivial = true;
+                for (uint32_t input : phi.inputs) {
+                    input = program.resolve(input);
+                    if (input == same || input == v) continue;
+                    if (same != kNone) {
+                        trivial = false;
+                        break;
+                    }
+                    same = input;
+                }
+                if (trivial && same != kNone) {
+                    program.replace(v, same);
+                    statistics.phis++;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    // Value numbering
+    using ValueKey = std::tuple<uint8_t, uint32_t, uint32_t, uint64_t>;
+
+    // Immediate dominators (Cooper, Harvey and Kennedy), relying on every block being numbered
+    // after its dominators.
+    std::vector<uint32_t> dominators() const {
+        std::vector<uint32_t> idom(program.blocks.size(), kNone);
+        idom[0] = 0;
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (uint32_t b = 1; b < program.blocks.size(); ++b) {
+                uint32_t dominator = kNone;
+                for (uint32_t predecessor : program.blocks[b].predecessors) {
+                    if (idom[predecessor] == kNone) continue;
+                    if (dominator == kNone) {
+                        dominator = predecessor;
+                        continue;
+                    }
+                    uint32_t x = predecessor;
+                    uint32_t y = dominator;
+                    while (x != y) {
+                        while (x > y) x = idom[x];
+                        while (y > x) y = idom[y];
+                    }
+                    dominator = x;
+                }
+                if (dominator != idom[b]) {
+                    idom[b] = dominator;
+                    changed = true;
+                }
+            }
+        }
+        return idom;
+    }
+
+    static bool isCommutative(IrOp op) {
+        return op == IrOp::ADD || op == IrOp::MULTIPLY || op == IrOp::EQUAL || op == IrOp::NOT_EQUAL;
+    }
+
+    // Computes op over constants, unless it would raise a runtime error.
+    static bool fold(IrOp op, double a, double b, double& out) {
+        switch (op) {
+            case IrOp::NEG: out = -a; return true;
+            case IrOp::NOT: out = a != 0.0 ? 0.0 : 1.0; return true;
+            case IrOp::ADD: out = a + b; return true;
+            case IrOp::SUBTRACT: out = a - b; return true;
+            case IrOp::MULTIPLY: out = a * b; return true;
+            case IrOp::DIVIDE:
+                if (b == 0) return false;
+                out = a / b;
+                return true;
+            case IrOp::GREATER: out = a > b ? 1.0 : 0.0; return true;
+            case IrOp::GREATER_EQUAL: out = a >= b ? 1.0 : 0.0; return true;
+            case IrOp::LESS: out = a < b ? 1.0 : 0.0; return true;
+            case IrOp::LESS_EQUAL: out = a <= b ? 1.0 : 0.0; return true;
+            case IrOp::EQUAL: out = a == b ? 1.0 : 0.0; return true;
+            case IrOp::NOT_EQUAL: out = a != b ? 1.0 : 0.0; return true;
+            default: return false;
+        }
+    }
+
+    // Walks the dominator tree keeping the values of the dominating blocks in a table. A value
+    // equal to one in the table is replaced by it. A division is kept only once too: the
+    // dominating one would already have failed.
+    void numberValues() {
+        std::vector<uint32_t> idom = dominators();
+        std::vector<std::vector<uint32_t>> children(program.blocks.size());
+        for (uint32_t b = 1; b < program.blocks.size(); ++b) children[idom[b]].push_back(b);
+
+        std::map<ValueKey, uint32_t> table;
+        std::vector<ValueKey> added;            // keys in the order they were added
+        std::vector<std::pair<uint32_t, size_t>> stack;  // block, size of added before it; kNone = leave
+        stack.push_back({0, 0});
+        while (!stack.empty()) {
+            auto [block, mark] = stack.back();
+            stack.pop_back();
+            if (block == kNone) {
+                while (added.size() > mark) {
+                    table.erase(added.back());
+                    added.pop_back();
+                }
+                continue;
+            }
+            stack.push_back({kNone, added.size()});
+            numberBlock(block, table, added);
+            for (auto it = children[block].rbegin(); it != children[block].rend(); ++it) {
+                stack.push_back({*it, 0});
+            }
+        }
+        removeTrivialPhis();
+        program.compact();
+    }
+
+    void numberBlock(uint32_t block, std::map<ValueKey, uint32_t>& table, std::vector<ValueKey>& added) {
+        for (uint32_t v : program.blocks[block].values) {
+            IrValue& value = program.values[v];
+            if (value.op == IrOp::PHI || value.op == IrOp::PRINT) continue;
+            if (value.a != kNone) value.a = program.resolve(value.a);
+            if (value.b != kNone) value.b = program.resolve(value.b);
+
+            const IrValue* a = value.a != kNone ? &program.values[value.a] : nullptr;
+            const IrValue* b = value.b != kNone ? &program.values[value.b] : nullptr;
+            double folded;
+            if (a && a->op == IrOp::CONST && (!b || b->op == IrOp::CONST) &&
+                fold(value.op, a->constant, b ? b->constant : 0.0, folded)) {
+                value.op = IrOp::CONST;
+                value.constant = folded;
+                value.a = kNone;
+                value.b = kNone;
+                statistics.folded++;
+            }
+
+            uint32_t left = value.a;
+            uint32_t right = value.b;
+            IrOp op = value.op;
+            if (isCommutative(op) && left > right) std::swap(left, right);
+            if (op == IrOp::GREATER || op == IrOp::GREATER_EQUAL) {
+                op = op == IrOp::GREATER ? IrOp::LESS : IrOp::LESS_EQUAL;
+                std::swap(left, right);
+            }
+            uint64_t bits = 0;
+            if (op == IrOp::CONST) std::memcpy(&bits, &value.constant, sizeof bits);
+            ValueKey key{static_cast<uint8_t>(op), left, right, bits};
+
+            auto [it, inserted] = table.emplace(key, v);
+            if (inserted) {
+                added.push_back(key);
+            } else {
+                program.replace(v, it->second);
+                statistics.numbered++;
+            }
+        }
+    }
+
+    // Dead code elimination
+    bool mayFail(const IrValue& value) const {
+        if (value.op != IrOp::DIVIDE) return false;
+        const IrValue& divisor = program.values[value.b];
+        return divisor.op != IrOp::CONST || divisor.constant == 0;
+    }
+
+    void eliminateDeadCode() {
+        std::vector<bool> live(program.values.size(), false);
+        std::vector<uint32_t> worklist;
+        auto mark = [&](uint32_t v) {
+            if (v != kNone && !live[v]) {
+                live[v] = true;
+                worklist.push_back(v);
+            }
+        };
+        for (const IrBlock& block : program.blocks) {
+            for (uint32_t v : block.values) {
+                if (program.values[v].op == IrOp::PRINT || mayFail(program.values[v])) mark(v);
+            }
+            mark(block.condition);
+        }
+        while (!worklist.empty()) {
+            const IrValue& value = program.values[worklist.back()];
+            worklist.pop_back();
+            mark(value.a);
+            mark(value.b);
+            for (uint32_t input : value.inputs) mark(input);
+        }
+        for (const IrBlock& block : program.blocks) {
+            for (uint32_t v : block.values) {
+                if (!live[v]) {
+                    program.values[v].removed = true;
+                    statistics.dead++;
+                }
+            }
+        }
+        program.compact();
+    }
+
+    // Register allocation
+    struct Interval {
+        uint32_t value;
+        uint32_t start;
+        uint32_t end;
+    };
+
+    // Numbers the program in block order: phis at their block's start, the moves and the exit at
+    // its end. A value used inside a loop it is not defined in stays live to the end of that loop.
+    std::vector<Interval> intervals(std::vector<uint32_t>& blockStart, std::vector<uint32_t>& blockEnd) const {
+        std::vector<uint32_t> position(program.values.size(), 0);
+        uint32_t next = 0;
+        for (uint32_t b = 0; b < program.blocks.size(); ++b) {
+            blockStart[b] = next;
+            next += 2;
+            for (uint32_t v : program.blocks[b].values) {
+                if (program.values[v].op == IrOp::PHI) {
+                    position[v] = blockStart[b];
+                } else {
+                    position[v] = next;
+                    next += 2;
+                }
+            }
+            blockEnd[b] = next;
+            next += 2;
+        }
+
+        std::vector<uint32_t> end(position);
+        auto use = [&](uint32_t v, uint32_t block, uint32_t at) {
+            if (program.values[v].op == IrOp::CONST) return;
+            uint32_t definition = position[v];
+            uint32_t last = at;
+            for (uint32_t loop = program.blocks[block].loop; loop != kNone; loop = program.loops[loop].parent) {
+                const IrLoop& l = program.loops[loop];
+                if (definition >= blockStart[l.header] && definition <= blockEnd[l.latch]) break;
+                last = blockEnd[l.latch];
+            }
+            end[v] = std::max(end[v], last);
+        };
+        for (uint32_t b = 0; b < program.blocks.size(); ++b) {
+            const IrBlock& block = program.blocks[b];
+            for (uint32_t v : block.values) {
+                const IrValue& value = program.values[v];
+                if (value.op == IrOp::PHI) {
+                    for (size_t i = 0; i < value.inputs.size(); ++i) {
+                        uint32_t predecessor = block.predecessors[i];
+                        use(value.inputs[i], predecessor, blockEnd[predecessor]);
+                    }
+                    continue;
+                }
+                if (value.a != kNone) use(value.a, b, position[v]);
+                if (value.b != kNone) use(value.b, b, position[v]);
+            }
+            if (block.condition != kNone) use(block.condition, b, blockEnd[b]);
+        }
+
+        std::vector<Interval> result;
+        for (const IrBlock& block : program.blocks) {
+            for (uint32_t v : block.values) {
+                IrOp op = program.values[v].op;
+                if (op != IrOp::CONST && op != IrOp::PRINT) result.push_back({v, position[v], end[v]});
+            }
+        }
+        std::sort(result.begin(), result.end(), [](const Interval& x, const Interval& y) {
+            return x.start != y.start ? x.start < y.start : x.value < y.value;
+        });
+        return result;
+    }
+
+    // Poletto and Sarkar's linear scan: when no register is free, the interval that ends last
+    // goes to a spill slot.
+    RegisterProgram allocate() {
+        std::vector<uint32_t> blockStart(program.blocks.size());
+        std::vector<uint32_t> blockEnd(program.blocks.size());
+        std::vector<Interval> all = intervals(blockStart, blockEnd);
+
+        const uint32_t kSpilled = 0x80000000u;  // location flag: the low bits are a spill slot
+        std::vector<uint32_t> location(program.values.size(), kNone);
+        std::vector<Interval> active;  // sorted by end
+        std::vector<uint32_t> freeRegisters;
+        for (uint32_t r = kRegisters; r > 0; --r) freeRegisters.push_back(r - 1);
+        uint32_t registersUsed = 0;
+        uint32_t spillSlots = 0;
+
+        auto activate = [&](const Interval& interval) {
+            auto at = std::upper_bound(active.begin(), active.end(), interval,
+                                       [](const Interval& x, const Interval& y) { return x.end < y.end; });
+            active.insert(at, interval);
+        };
+        for (const Interval& interval : all) {
+            while (!active.empty() && active.front().end < interval.start) {
+                freeRegisters.push_back(location[active.front().value]);
+                active.erase(active.begin());
+            }
+            if (!freeRegisters.empty()) {
+                location[interval.value] = freeRegisters.back();
+                freeRegisters.pop_back();
+                registersUsed = std::max(registersUsed, location[interval.value] + 1);
+                activate(interval);
+                continue;
+            }
+            statistics.spilled++;
+            Interval last = active.back();
+            if (last.end > interval.end) {
+                location[interval.value] = location[last.value];
+                location[last.value] = kSpilled | spillSlots++;
+                active.pop_back();
+                activate(interval);
+            } else {
+                location[interval.value] = kSpilled | spillSlots++;
+            }
+        }
+
+        RegisterProgram code;
+        code.registers = registersUsed;
+        code.spillSlots = spillSlots;
+        code.frame.assign(registersUsed + spillSlots, 0.0);
+        std::map<uint64_t, uint32_t> constantSlots;
+        for (const IrBlock& block : program.blocks) {
+            for (uint32_t v : block.values) {
+                if (program.values[v].op != IrOp::CONST) continue;
+                uint64_t bits;
+                std::memcpy(&bits, &program.values[v].constant, sizeof bits);
+                auto [it, inserted] = constantSlots.emplace(bits, static_cast<uint32_t>(code.frame.size()));
+                if (inserted) code.frame.push_back(program.values[v].constant);
+                location[v] = it->second;
+            }
+        }
+        code.constants = static_cast<uint32_t>(constantSlots.size());
+        for (uint32_t& l : location) {
+            if (l != kNone && (l & kSpilled)) l = registersUsed + (l & ~kSpilled);
+        }
+        uint32_t scratch = static_cast<uint32_t>(code.frame.size());
+        code.frame.push_back(0.0);
+
+        emitCode(code, location, scratch);
+        return code;
+    }
+
+    static RegisterOp registerOp(IrOp op) {
+        switch (op) {
+            case IrOp::NEG: return RegisterOp::NEG;
+            case IrOp::NOT: return RegisterOp::NOT;
+            case IrOp::ADD: return RegisterOp::ADD;
+            case IrOp::SUBTRACT: return RegisterOp::SUBTRACT;
+            case IrOp::MULTIPLY: return RegisterOp::MULTIPLY;
+            case IrOp::DIVIDE: return RegisterOp::DIVIDE;
+            case IrOp::GREATER: return RegisterOp::GREATER;
+            case IrOp::GREATER_EQUAL: return RegisterOp::GREATER_EQUAL;
+            case IrOp::LESS: return RegisterOp::LESS;
+            case IrOp::LESS_EQUAL: return RegisterOp::LESS_EQUAL;
+            case IrOp::EQUAL: return RegisterOp::EQUAL;
+            case IrOp::NOT_EQUAL: return RegisterOp::NOT_EQUAL;
+            default: return RegisterOp::MOVE;
+        }
+    }
+
+    void emitCode(RegisterProgram& code, const std::vector<uint32_t>& location, uint32_t scratch) const {
+        std::vector<uint32_t> blockAddress(program.blocks.size());
+        std::vector<std::pair<size_t, uint32_t>> patches;  // instruction field to patch, target block
+        auto emit = [&](RegisterOp op, uint32_t destination, uint32_t a, uint32_t b, int line) {
+            code.code.push_back({op, destination, a, b, line});
+        };
+
+        for (uint32_t b = 0; b < program.blocks.size(); ++b) {
+            const IrBlock& block = program.blocks[b];
+            blockAddress[b] = static_cast<uint32_t>(code.code.size());
+            for (uint32_t v : block.values) {
+                const IrValue& value = program.values[v];
+                if (value.op == IrOp::PHI || value.op == IrOp::CONST) continue;
+                if (value.op == IrOp::PRINT) {
+                    emit(RegisterOp::PRINT, 0, location[value.a], 0, value.line);
+                } else {
+                    emit(registerOp(value.op), location[v], location[value.a],
+                         value.b != kNone ? location[value.b] : 0, value.line);
+                }
+            }
+
+            switch (block.exit) {
+                case IrExit::JUMP:
+                    emitMoves(code, location, scratch, b, block.target);
+                    if (block.target != b + 1) {
+                        patches.push_back({code.code.size(), block.target});
+                        emit(RegisterOp::JUMP, 0, 0, 0, 0);
+                    }
+                    break;
+                case IrExit::BRANCH:
+                    patches.push_back({code.code.size(), block.otherwise});
+                    emit(RegisterOp::JUMP_IF_FALSE, 0, location[block.condition], 0, 0);
+                    if (block.target != b + 1) {
+                        patches.push_back({code.code.size(), block.target});
+                        emit(RegisterOp::JUMP, 0, 0, 0, 0);
+                    }
+                    break;
+                case IrExit::RETURN:
+                    emit(RegisterOp::HALT, 0, 0, 0, 0);
+                    break;
+            }
+        }
+        for (const auto& [at, target] : patches) {
+            RegisterInstruction& instruction = code.code[at];
+            (instruction.op == RegisterOp::JUMP ? instruction.a : instruction.b) = blockAddress[target];
+        }
+    }
+
+    // The phis of `to` all take their input from `from` at once. Moves whose destination no
+    // other move still reads go first; a cycle is broken by saving one destination in scratch.
+    void emitMoves(RegisterProgram& code, const std::vector<uint32_t>& location, uint32_t scratch, uint32_t from,
+                   uint32_t to) const {
+        const IrBlock& target = program.blocks[to];
+        size_t edge = std::find(target.predecessors.begin(), target.predecessors.end(), from) - target.predecessors.begin();
+        std::vector<std::pair<uint32_t, uint32_t>> moves;  // destination, source
+        for (uint32_t v : target.values) {
+            const IrValue& phi = program.values[v];
+            if (phi.op != IrOp::PHI) break;
+            uint32_t source = location[phi.inputs[edge]];
+            if (source != location[v]) moves.push_back({location[v], source});
+        }
+        while (!moves.empty()) {
+            bool progress = false;
+            for (size_t i = 0; i < moves.size(); ++i) {
+                uint32_t destination = moves[i].first;
+                bool read = false;
+                for (size_t j = 0; j < moves.size(); ++j) {
+                    if (j != i && moves[j].second == destination) read = true;
+                }
+                if (read) continue;
+                code.code.push_back({RegisterOp::MOVE, destination, moves[i].second, 0, 0});
+                moves.erase(moves.begin() + static_cast<std::ptrdiff_t>(i));
+                progress = true;
+                break;
+            }
+            if (progress) continue;
+            uint32_t saved = moves.front().first;
+            code.code.push_back({RegisterOp::MOVE, scratch, saved, 0, 0});
+            for (auto& move : moves) {
+                if (move.second == saved) move.second = scratch;
+            }
+        }
+    }
+};
+
+class RegisterVM {
+public:
+    RegisterVM(std::ostream& out = std::cout, FlushPolicy policy = FlushPolicy::THRESHOLD,
+               std::ostream& err = std::cerr)
+        : output(out, policy), errors(&err) {}
+
+    void run(const RegisterProgram& program) {
+        try {
+            execute(program);
+        } catch (const std::runtime_error& error) {
+            output.flush();
+            *errors << "Runtime error: " << error.what() << "\n";
+        }
+        output.flush();
+    }
+
+private:
+    OutputBuffer output;
+    std::ostream* errors;
+    std::vector<double> frame;
+
+    void execute(const RegisterProgram& program) {
+        frame = program.frame;
+        double* f = frame.data();
+        const RegisterInstruction* code = program.code.data();
+        size_t pc = 0;
+        for (;;) {
+            const RegisterInstruction& instruction = code[pc++];
+            switch (instruction.op) {
+                case RegisterOp::MOVE: f[instruction.destination] = f[instruction.a]; break;
+                case RegisterOp::NEG: f[instruction.destination] = -f[instruction.a]; break;
+                case RegisterOp::NOT: f[instruction.destination] = f[instruction.a] != 0.0 ? 0.0 : 1.0; break;
+                case RegisterOp::ADD: f[instruction.destination] = f[instruction.a] + f[instruction.b]; break;
+                case RegisterOp::SUBTRACT: f[instruction.destination] = f[instruction.a] - f[instruction.b]; break;
+                case RegisterOp::MULTIPLY: f[instruction.destination] = f[instruction.a] * f[instruction.b]; break;
+                case RegisterOp::DIVIDE:
+                    if (f[instruction.b] == 0) {
+                        throw std::runtime_error("Division by zero at line " + std::to_string(instruction.line));
+                    }
+                    f[instruction.destination] = f[instruction.a] / f[instruction.b];
+                    break;
+                case RegisterOp::GREATER: f[instruction.destination] = f[instruction.a] > f[instruction.b] ? 1.0 : 0.0; break;
+                case RegisterOp::GREATER_EQUAL:
+                    f[instruction.destination] = f[instruction.a] >= f[instruction.b] ? 1.0 : 0.0;
+                    break;
+                case RegisterOp::LESS: f[instruction.destination] = f[instruction.a] < f[instruction.b] ? 1.0 : 0.0; break;
+                case RegisterOp::LESS_EQUAL:
+                    f[instruction.destination] = f[instruction.a] <= f[instruction.b] ? 1.0 : 0.0;
+                    break;
+                case RegisterOp::EQUAL: f[instruction.destination] = f[instruction.a] == f[instruction.b] ? 1.0 : 0.0; break;
+                case RegisterOp::NOT_EQUAL:
+                    f[instruction.destination] = f[instruction.a] != f[instruction.b] ? 1.0 : 0.0;
+                    break;
+                case RegisterOp::PRINT: output.printNumber(f[instruction.a]); break;
+                case RegisterOp::JUMP: pc = instruction.a; break;
+                case RegisterOp::JUMP_IF_FALSE:
+                    if (f[instruction.a] == 0.0) pc = instruction.b;
+                    break;
+                case RegisterOp::HALT: return;
+            }
+        }
+    }
+};
+#endif
@@ -0,0 +1,135 @@
+#include "tokenization.cpp"
+#include <cctype>
+#include <istream>
+
+/*1a. Streaming Tokenization (StreamingLexer)
+Produces the same tokens as Lexer::scanTokens, but one at a time, reading the input through a
+fixed-size buffer. The Parser pulls tokens from a TokenSource on demand, so no more than its
+lookahead window is ever in memory, whatever the size of the input.*/
+
+#ifndef STREAMING_LEXER
+#define STREAMING_LEXER
+
+class TokenSource {
+public:
+    virtual ~TokenSource() = default;
+
+    // Returns the next token; keeps returning END_OF_FILE once the input is exhausted.
+    virtual Token next() = 0;
+};
+
+class StreamingLexer : public TokenSource {
+public:
+    explicit StreamingLexer(std::istream& input, size_t bufferSize = 64 * 1024)
+        : input(input), buffer(bufferSize) {}
+
+    Token next() override {
+        for (;;) {
+            int c = advance();
+            if (c == EOF) return Token{TokenType::END_OF_FILE, "", line};
+
+            switch (c) {
+                case '(': return single(TokenType::LEFT_PAREN, c);
+                case ')': return single(TokenType::RIGHT_PAREN, c);
+                case '{': return single(TokenType::LEFT_BRACE, c);
+                case '}': return single(TokenType::RIGHT_BRACE, c);
+                case ';': return single(TokenType::SEMICOLON, c);
+                case '-': return single(TokenType::MINUS, c);
+                case '+': return single(TokenType::PLUS, c);
+                case '*': return single(TokenType::STAR, c);
+                case '!': return pair('=', TokenType::BANG_EQUAL, "!=", TokenType::BANG, "!");
+                case '=': return pair('=', TokenType::EQUAL_EQUAL, "==", TokenType::EQUAL, "=");
+                case '<': return pair('=', TokenType::LESS_EQUAL, "<=", TokenType::LESS, "<");
+                case '>': return pair('=', TokenType::GREATER_EQUAL, ">=", TokenType::GREATER, ">");
+                case '/':
+                    if (peek() == '/') {
+                        while (peek() != '\n' && peek() != EOF) advance();
+                        break;
+                    }
+                    return single(TokenType::SLASH, c);
+                case ' ':
+                case '\r':
+                case '\t':
+                    break;
+                case '\n':
+                    line++;
+                    break;
+                default:
+                    if (std::isdigit(c)) return number(c);
+                    if (std::isalpha(c) || c == '_') return identifier(c);
+                    std::cerr << "Unexpected character at line " << line << "\n";
+                    break;
+            }
+        }
+    }
+
+private:
+    std::istream& input;
+    std::vector<char> buffer;
+    size_t position = 0;
+    size_t length = 0;
+    int line = 1;
+
+    bool fill() {
+        input.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        length = static_cast<size_t>(input.gcount());
+        position = 0;
+        return length > 0;
+    }
+
+    int peek() {
+        if (position == length && !fill()) return EOF;
+        return static_cast<unsigned char>(buffer[position]);
+    }
+
+    int advance() {
+        int c = peek();
+        if (c != EOF) position++;
+        return c;
+    }
+
+    Token single(TokenType type, int c) {
+        return Token{type, std::string(1, static_cast<char>(c)), line};
+    }
+
+    Token pair(char second, TokenType matched, const char* matchedLexeme, TokenType plain, const char* plainLexeme) {
+        if (peek() == second) {
+            advance();
+            return Token{matched, matchedLexeme, line};
+        }
+        return Token{plain, plainLexeme, line};
+    }
+
+    Token number(int first) {
+        std::string lexeme(1, static_cast<char>(first));
+        while (std::isdigit(peek())) lexeme += static_cast<char>(advance());
+
+        // A '.' only belongs to the number when a digit follows it. The language has no other
+        // use for '.', so a trailing one is reported like any unexpected character.
+        if (peek() == '.') {
+            advance();
+            if (!std::isdigit(peek())) {
+                std::cerr << "Unexpected character at line " << line << "\n";
+                return Token{TokenType::NUMBER, lexeme, line};
+            }
+            lexeme += '.';
+            while (std::isdigit(peek())) lexeme += static_cast<char>(advance());
+        }
+        return Token{TokenType::NUMBER, lexeme, line};
+    }
+
+    Token identifier(int first) {
+        std::string lexeme(1, static_cast<char>(first));
+        while (std::isalnum(peek()) || peek() == '_') lexeme += static_cast<char>(advance());
+
+        static const std::unordered_map<std::string, TokenType> keywords = {
+            {"and", TokenType::AND},     {"else", TokenType::ELSE},   {"false", TokenType::FALSE},
+            {"if", TokenType::IF},       {"let", TokenType::LET},     {"nil", TokenType::NIL},
+            {"or", TokenType::OR},       {"print", TokenType::PRINT}, {"true", TokenType::TRUE},
+            {"while", TokenType::WHILE},
+        };
+        auto keyword = keywords.find(lexeme);
+        return Token{keyword == keywords.end() ? TokenType::IDENTIFIER : keyword->second, lexeme, line};
+    }
+};
+#endif
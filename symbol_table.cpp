@@ -0,0 +1,84 @@
+#include "tokenization.cpp"
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+
+// 1b. Interning (SymbolTable, SymbolToken)
+// Every lexeme that ends up in the AST is interned once into a process-wide table: equal
+// names get the same dense integer id, and the text lives in the table for the rest of the
+// run. Nodes store a SymbolToken instead of a Token, so they carry no std::string of their own,
+// and the Resolver, the environments and the compilers compare ids instead of hashing names.
+
+#ifndef SYMBOL_TABLE
+#define SYMBOL_TABLE
+
+class SymbolTable {
+public:
+    static SymbolTable& global() {
+        static SymbolTable table;
+        return table;
+    }
+
+    // Returns the id of text, adding it on first sight, and points stored at the interned copy.
+    // Safe to call from several threads.
+    uint32_t intern(std::string_view text, std::string_view& stored) {
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            auto it = ids.find(text);
+            if (it != ids.end()) {
+                stored = it->first;
+                return it->second;
+            }
+        }
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        auto it = ids.find(text);
+        if (it == ids.end()) {
+            names.emplace_back(text);
+            it = ids.emplace(std::string_view(names.back()), static_cast<uint32_t>(names.size() - 1)).first;
+        }
+        stored = it->first;
+        return it->second;
+    }
+
+    uint32_t intern(std::string_view text) {
+        std::string_view stored;
+        return intern(text, stored);
+    }
+
+    // The interned text of id; stays valid for the lifetime of the table.
+    std::string_view name(uint32_t id) const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return names[id];
+    }
+
+    size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return names.size();
+    }
+
+private:
+    mutable std::shared_mutex mutex;
+    std::deque<std::string> names;  // a deque never moves its elements, so views stay valid
+    std::unordered_map<std::string_view, uint32_t> ids;
+};
+
+// The token kept in AST nodes: kind, line, interned id and a view of the interned text.
+struct SymbolToken {
+    std::string_view lexeme;
+    uint32_t symbol = 0;
+    int line = 0;
+    TokenType type = TokenType::END_OF_FILE;
+
+    SymbolToken() = default;
+
+    explicit SymbolToken(const Token& token) : SymbolToken(token.type, token.lexeme, token.line) {}
+
+    SymbolToken(TokenType type, std::string_view text, int line)
+        : symbol(SymbolTable::global().intern(text, lexeme)), line(line), type(type) {}
+};
+
+static_assert(std::is_trivially_copyable<SymbolToken>::value, "AST tokens must stay trivially copyable");
+#endif
@@ -0,0 +1,180 @@
+#include "bytecode_vm.cpp"
+#include <chrono>
+
+// 16. Tiered Execution (BytecodeLoopTier)
+// Lets the tree-walking Interpreter start every program and move only its hot loops to the
+// bytecode VM. The Interpreter counts the iterations of every WhileStmt; once a loop crosses the
+// threshold it is compiled on its own, and from its next condition check on it runs in the VM.
+// The variables the loop uses but does not declare are copied from the Interpreter's environment
+// into the first VM slots before the run and copied back after it, also when the run fails.
+
+#ifndef TIERED_EXECUTION
+#define TIERED_EXECUTION
+
+// One promoted loop, for the statistics.
+struct PromotedLoop {
+    int line = 0;
+    size_t iterationsBefore = 0;  // iterations the Interpreter ran before the promotion
+    double promotedAt = 0;        // seconds since the tier was created
+    size_t runs = 0;              // times the VM ran the loop, one per entry after promotion
+};
+
+class BytecodeLoopTier : public LoopTier {
+public:
+    explicit BytecodeLoopTier(bool fuse = true)
+        : compiler(fuse), vm(std::cout, FlushPolicy::ON_EXIT, fuse), created(std::chrono::steady_clock::now()) {}
+
+    bool run(WhileStmt& loop, size_t iterations, Environment& environment, OutputBuffer& output) override {
+        auto it = compiled.find(&loop);
+        if (it == compiled.end()) {
+            it = compiled.emplace(&loop, compile(loop, iterations)).first;
+            if (!it->second) {
+                declined++;
+                return false;
+            }
+        }
+        CompiledLoop& compiledLoop = *it->second;
+        promoted[compiledLoop.index].runs++;
+
+        std::vector<double>& slots = compiledLoop.slots;
+        for (size_t i = 0; i < compiledLoop.inputs.size(); ++i) {
+            slots[i] = environment.getAt(compiledLoop.inputs[i].depth, compiledLoop.inputs[i].slot);
+        }
+        try {
+            vm.run(compiledLoop.chunk, slots, output);
+        } catch (...) {
+            copyOut(compiledLoop, environment);
+            throw;
+        }
+        copyOut(compiledLoop, environment);
+        return true;
+    }
+
+    const std::vector<PromotedLoop>& promotions() const { return promoted; }
+    size_t declinedLoops() const { return declined; }
+
+    void report(std::ostream& out) const {
+        out << "Tiering: " << promoted.size() << " loops promoted, " << declined << " declined\n";
+        for (const PromotedLoop& loop : promoted) {
+            out << "  loop at line " << loop.line << ": promoted after " << loop.iterationsBefore
+                << " iterations at " << loop.promotedAt * 1000.0 << " ms, " << loop.runs << " VM runs\n";
+        }
+    }
+
+private:
+    // A variable from outside the loop, where the Interpreter keeps it relative to the loop's scope.
+    struct Input {
+        int depth;
+        int slot;
+    };
+
+    struct CompiledLoop {
+        Chunk chunk;
+        std::vector<Input> inputs;  // input i lives in VM slot i
+        std::vector<double> slots;  // kept between runs to avoid reallocating
+        size_t index = 0;           // into promoted
+    };
+
+    // Collects the variables a loop reads or writes that are declared outside it.
+    class InputCollector : public ExprVisitor, public StmtVisitor {
+    public:
+        std::vector<SymbolToken> names;
+        std::vector<Input> inputs;
+        bool resolved = true;
+
+        void collect(WhileStmt& loop) {
+            loop.condition->accept(*this);
+            loop.body->accept(*this);
+        }
+
+    private:
+        int blocks = 0;  // blocks entered inside the loop so far
+
+        void use(const SymbolToken& name, int depth, int slot) {
+            if (depth < 0 || slot < 0) {
+                resolved = false;
+                return;
+            }
+            if (depth < blocks) return;  // declared inside the loop
+            Input input{depth - blocks, slot};
+            for (size_t i = 0; i < inputs.size(); ++i) {
+                if (inputs[i].depth == input.depth && inputs[i].slot == input.slot) return;
+                // One name has to mean one variable for the compiler to bind it by name.
+                if (names[i].symbol == name.symbol) resolved = false;
+            }
+            names.push_back(name);
+            inputs.push_back(input);
+        }
+
+        // ExprVisitor implementations
+        void visitLiteralExpr(LiteralExpr&) override {}
+        void visitVariableExpr(VariableExpr& expr) override { use(expr.name, expr.depth, expr.slot); }
+        void visitUnaryExpr(UnaryExpr& expr) override { expr.right->accept(*this); }
+        void visitBinaryExpr(BinaryExpr& expr) override {
+            expr.left->accept(*this);
+            expr.right->accept(*this);
+        }
+        void visitAssignmentExpr(AssignmentExpr& expr) override {
+            expr.value->accept(*this);
+            use(expr.name, expr.depth, expr.slot);
+        }
+
+        // StmtVisitor implementations
+        void visitExpressionStmt(ExpressionStmt& stmt) override { stmt.expression->accept(*this); }
+        void visitVariableDeclarationStmt(VariableDeclarationStmt& stmt) override {
+            if (stmt.initializer) stmt.initializer->accept(*this);
+        }
+        void visitBlockStmt(BlockStmt& stmt) override {
+            blocks++;
+            for (const auto& statement : stmt.statements) statement->accept(*this);
+            blocks--;
+        }
+        void visitIfStmt(IfStmt& stmt) override {
+            stmt.condition->accept(*this);
+            stmt.thenBranch->accept(*this);
+            if (stmt.elseBranch) stmt.elseBranch->accept(*this);
+        }
+        void visitWhileStmt(WhileStmt& stmt) override {
+            stmt.condition->accept(*this);
+            stmt.body->accept(*this);
+        }
+        void visitPrintStmt(PrintStmt& stmt) override { stmt.expression->accept(*this); }
+    };
+
+    BytecodeCompiler compiler;
+    VM vm;
+    std::chrono::steady_clock::time_point created;
+    std::unordered_map<WhileStmt*, std::unique_ptr<CompiledLoop>> compiled;  // null when declined
+    std::vector<PromotedLoop> promoted;
+    size_t declined = 0;
+
+    std::unique_ptr<CompiledLoop> compile(WhileStmt& loop, size_t iterations) {
+        InputCollector collector;
+        collector.collect(loop);
+        if (!collector.resolved) return nullptr;
+
+        auto compiledLoop = std::make_unique<CompiledLoop>();
+        try {
+            compiledLoop->chunk = compiler.compileLoop(loop, collector.names);
+        } catch (const std::runtime_error&) {
+            return nullptr;  // too many slots for the VM
+        }
+        compiledLoop->inputs = std::move(collector.inputs);
+        compiledLoop->slots.assign(compiledLoop->chunk.slotCount, 0.0);
+        compiledLoop->index = promoted.size();
+
+        PromotedLoop promotion;
+        promotion.line = loop.line;
+        promotion.iterationsBefore = iterations;
+        promotion.promotedAt = std::chrono::duration<double>(std::chrono::steady_clock::now() - created).count();
+        promoted.push_back(promotion);
+        return compiledLoop;
+    }
+
+    static void copyOut(const CompiledLoop& compiledLoop, Environment& environment) {
+        for (size_t i = 0; i < compiledLoop.inputs.size(); ++i) {
+            environment.assignAt(compiledLoop.inputs[i].depth, compiledLoop.inputs[i].slot, compiledLoop.slots[i]);
+        }
+    }
+};
+#endif